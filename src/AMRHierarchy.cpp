@@ -0,0 +1,396 @@
+#include "AMRHierarchy.h"
+
+namespace {
+
+// Trilinear sample of a base-grid field at (fractional) cell coordinates,
+// clamped to the grid
+double sampleBase(const Field& field, int nx, int ny, int nz,
+                  double x, double y, double z) {
+    x = std::max(0.0, std::min(x, nx - 1.0));
+    y = std::max(0.0, std::min(y, ny - 1.0));
+    z = std::max(0.0, std::min(z, nz - 1.0));
+
+    int i0 = std::min(static_cast<int>(x), nx - 2), i1 = i0 + 1;
+    int j0 = std::min(static_cast<int>(y), ny - 2), j1 = j0 + 1;
+    int k0 = std::min(static_cast<int>(z), nz - 2), k1 = k0 + 1;
+
+    double sx1 = x - i0, sx0 = 1.0 - sx1;
+    double sy1 = y - j0, sy0 = 1.0 - sy1;
+    double sz1 = z - k0, sz0 = 1.0 - sz1;
+
+    auto at = [&](int i, int j, int k) {
+        return field[i + static_cast<size_t>(nx) * (j + static_cast<size_t>(ny) * k)];
+    };
+    return sz0 * (sy0 * (sx0 * at(i0, j0, k0) + sx1 * at(i1, j0, k0)) +
+                  sy1 * (sx0 * at(i0, j1, k0) + sx1 * at(i1, j1, k0))) +
+           sz1 * (sy0 * (sx0 * at(i0, j0, k1) + sx1 * at(i1, j0, k1)) +
+                  sy1 * (sx0 * at(i0, j1, k1) + sx1 * at(i1, j1, k1)));
+}
+
+} // namespace
+
+AMRHierarchy::AMRHierarchy(FluidSolver& base, const Geometry& geometry, int block_size)
+    : base(base), geometry(geometry), block_size(block_size),
+      nbx(base.getNx() / block_size),
+      nby(base.getNy() / block_size),
+      nbz(base.getNz() / block_size),
+      regrid_interval(10),
+      step_count(0) {
+    block_to_patch.assign(nbx * nby * nbz, -1);
+    
+    // Metrics must describe the synchronised base field, see step()
+    base.setMetricsDeferred(true);
+}
+
+bool AMRHierarchy::flagBlock(int bi, int bj, int bk) const {
+    int nx = base.getNx(), ny = base.getNy(), nz = base.getNz();
+    int lo[3] = {bi * block_size, bj * block_size, bk * block_size};
+
+    // Blocks touching the domain faces stay on the base grid, where the
+    // wind tunnel boundary conditions are applied
+    if (lo[0] == 0 || lo[1] == 0 || lo[2] == 0 ||
+        lo[0] + block_size >= nx || lo[1] + block_size >= ny || lo[2] + block_size >= nz) {
+        return false;
+    }
+
+    const std::vector<bool>& obstacles = base.getObstacles();
+    auto idx = [nx, ny](int i, int j, int k) {
+        return i + static_cast<size_t>(nx) * (j + static_cast<size_t>(ny) * k);
+    };
+
+    // Obstacle proximity: any obstacle cell within the dilated block
+    if (criteria.obstacle_distance >= 0) {
+        int d = criteria.obstacle_distance;
+        for (int k = std::max(0, lo[2] - d); k < std::min(nz, lo[2] + block_size + d); ++k) {
+            for (int j = std::max(0, lo[1] - d); j < std::min(ny, lo[1] + block_size + d); ++j) {
+                for (int i = std::max(0, lo[0] - d); i < std::min(nx, lo[0] + block_size + d); ++i) {
+                    if (obstacles[idx(i, j, k)]) return true;
+                }
+            }
+        }
+    }
+
+    if (criteria.vorticity <= 0 && criteria.density_gradient <= 0) {
+        return false;
+    }
+
+    // Flow features, by central differences (the block never touches a face)
+    const Field& u = base.getVelocityU();
+    const Field& v = base.getVelocityV();
+    const Field& w = base.getVelocityW();
+    const Field& density = base.getDensity();
+    double inv_2dx = 0.5 / base.getDx();
+    double vort_limit = criteria.vorticity * criteria.vorticity;
+    double grad_limit = criteria.density_gradient * criteria.density_gradient;
+
+    for (int k = lo[2]; k < lo[2] + block_size; ++k) {
+        for (int j = lo[1]; j < lo[1] + block_size; ++j) {
+            for (int i = lo[0]; i < lo[0] + block_size; ++i) {
+                if (obstacles[idx(i, j, k)]) continue;
+
+                if (criteria.vorticity > 0) {
+                    double wx = (w[idx(i, j+1, k)] - w[idx(i, j-1, k)] -
+                                 v[idx(i, j, k+1)] + v[idx(i, j, k-1)]) * inv_2dx;
+                    double wy = (u[idx(i, j, k+1)] - u[idx(i, j, k-1)] -
+                                 w[idx(i+1, j, k)] + w[idx(i-1, j, k)]) * inv_2dx;
+                    double wz = (v[idx(i+1, j, k)] - v[idx(i-1, j, k)] -
+                                 u[idx(i, j+1, k)] + u[idx(i, j-1, k)]) * inv_2dx;
+                    if (wx*wx + wy*wy + wz*wz > vort_limit) return true;
+                }
+
+                if (criteria.density_gradient > 0) {
+                    double gx = (density[idx(i+1, j, k)] - density[idx(i-1, j, k)]) * inv_2dx;
+                    double gy = (density[idx(i, j+1, k)] - density[idx(i, j-1, k)]) * inv_2dx;
+                    double gz = (density[idx(i, j, k+1)] - density[idx(i, j, k-1)]) * inv_2dx;
+                    if (gx*gx + gy*gy + gz*gz > grad_limit) return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<FluidSolver> AMRHierarchy::createPatchSolver(const int lo[3]) const {
+    int n = 2 * block_size + 2;
+    double dx = base.getDx();
+
+    auto solver = std::make_unique<FluidSolver>(n, n, n, 0.5 * dx, 0.5 * base.getDt());
+    solver->setBoundaryMode(FluidSolver::BoundaryMode::External);
+    solver->setViscosity(base.getViscosity());
+    solver->setThermalDiffusivity(base.getThermalDiffusivity());
+    solver->setMassDiffusivity(base.getMassDiffusivity());
+
+    // Local cell 0 is fine cell 2 * lo - 1, centred at (lo - 3/4) * dx
+    solver->setObstacleMask(geometry.voxelize(n, n, n, 0.5 * dx,
+                                              (lo[0] - 0.75) * dx,
+                                              (lo[1] - 0.75) * dx,
+                                              (lo[2] - 0.75) * dx));
+
+    // Emitters overlapping the block emit into the fine cells splitting the
+    // covered base cells; restriction would otherwise overwrite the base
+    // grid's injection. The patch clock starts at zero now.
+    int nx = base.getNx(), ny = base.getNy();
+    double now = base.getTime();
+    for (const FluidSolver::Emitter& emitter : base.getEmitters()) {
+        if (emitter.end_time <= now) continue;
+
+        std::vector<uint8_t> mask(static_cast<size_t>(n) * n * n, 0);
+        bool overlaps = false;
+        for (const std::pair<size_t, int>& span : emitter.spans) {
+            for (size_t index = span.first; index < span.first + span.second; ++index) {
+                int i = static_cast<int>(index % nx) - lo[0];
+                int j = static_cast<int>((index / nx) % ny) - lo[1];
+                int k = static_cast<int>(index / (static_cast<size_t>(nx) * ny)) - lo[2];
+                if (i < 0 || j < 0 || k < 0 ||
+                    i >= block_size || j >= block_size || k >= block_size) {
+                    continue;
+                }
+                for (int dk = 1; dk <= 2; ++dk) {
+                    for (int dj = 1; dj <= 2; ++dj) {
+                        for (int di = 1; di <= 2; ++di) {
+                            mask[(2*i + di) + n * ((2*j + dj) + n * (2*k + dk))] = 1;
+                        }
+                    }
+                }
+                overlaps = true;
+            }
+        }
+        if (overlaps) {
+            solver->addMaskEmitter(mask, emitter.density_rate, emitter.temperature_rate,
+                                   emitter.start_time - now, emitter.end_time - now);
+        }
+    }
+    return solver;
+}
+
+void AMRHierarchy::fillFromBase(Patch& patch, double alpha, bool ghosts_only) {
+    FluidSolver& fine = *patch.solver;
+    int n = 2 * block_size + 2;
+    int nx = base.getNx(), ny = base.getNy(), nz = base.getNz();
+
+    const FluidSolver& coarse = base;
+    const Field* base_fields[6] = {
+        &coarse.getVelocityU(), &coarse.getVelocityV(), &coarse.getVelocityW(),
+        &coarse.getDensity(), &coarse.getTemperature(), &coarse.getPressure()};
+    const Field* old_fields[6] = {
+        &u_old, &v_old, &w_old, &density_old, &temperature_old, &pressure_old};
+    Field* fine_fields[6] = {
+        &fine.getVelocityU(), &fine.getVelocityV(), &fine.getVelocityW(),
+        &fine.getDensity(), &fine.getTemperature(), &fine.getPressure()};
+
+    for (int k = 0; k < n; ++k) {
+        for (int j = 0; j < n; ++j) {
+            for (int i = 0; i < n; ++i) {
+                bool ghost = i == 0 || j == 0 || k == 0 || i == n - 1 || j == n - 1 || k == n - 1;
+                if (ghosts_only && !ghost) continue;
+
+                int local = i + n * (j + n * k);
+                int g[3] = {2 * patch.lo[0] - 1 + i,
+                            2 * patch.lo[1] - 1 + j,
+                            2 * patch.lo[2] - 1 + k};
+
+                // Ghost inside a neighbouring patch: copy its fine data
+                if (ghosts_only) {
+                    int bi = g[0] / (2 * block_size);
+                    int bj = g[1] / (2 * block_size);
+                    int bk = g[2] / (2 * block_size);
+                    int q = (g[0] >= 0 && g[1] >= 0 && g[2] >= 0 && bi < nbx && bj < nby && bk < nbz)
+                          ? block_to_patch[blockIndex(bi, bj, bk)] : -1;
+                    if (q >= 0) {
+                        const Patch& other = patches[q];
+                        const FluidSolver& src = *other.solver;
+                        int src_local = (g[0] - 2 * other.lo[0] + 1) +
+                                        n * ((g[1] - 2 * other.lo[1] + 1) +
+                                             n * (g[2] - 2 * other.lo[2] + 1));
+                        (*fine_fields[0])[local] = src.getVelocityU()[src_local];
+                        (*fine_fields[1])[local] = src.getVelocityV()[src_local];
+                        (*fine_fields[2])[local] = src.getVelocityW()[src_local];
+                        (*fine_fields[3])[local] = src.getDensity()[src_local];
+                        (*fine_fields[4])[local] = src.getTemperature()[src_local];
+                        (*fine_fields[5])[local] = src.getPressure()[src_local];
+                        continue;
+                    }
+                }
+
+                // Interpolate from the base grid, blending in time
+                double x = 0.5 * g[0] - 0.25;
+                double y = 0.5 * g[1] - 0.25;
+                double z = 0.5 * g[2] - 0.25;
+                for (int f = 0; f < 6; ++f) {
+                    double value = sampleBase(*base_fields[f], nx, ny, nz, x, y, z);
+                    if (alpha < 1.0) {
+                        value = alpha * value +
+                                (1.0 - alpha) * sampleBase(*old_fields[f], nx, ny, nz, x, y, z);
+                    }
+                    (*fine_fields[f])[local] = value;
+                }
+            }
+        }
+    }
+}
+
+void AMRHierarchy::restrictPatch(const Patch& patch) {
+    const FluidSolver& fine = *patch.solver;
+    int n = 2 * block_size + 2;
+    int nx = base.getNx(), ny = base.getNy();
+
+    const std::vector<bool>& obstacles = base.getObstacles();
+    const Field* fine_fields[5] = {
+        &fine.getVelocityU(), &fine.getVelocityV(), &fine.getVelocityW(),
+        &fine.getDensity(), &fine.getTemperature()};
+    Field* base_fields[5] = {
+        &base.getVelocityU(), &base.getVelocityV(), &base.getVelocityW(),
+        &base.getDensity(), &base.getTemperature()};
+
+    // Each base cell gets the average of the 2x2x2 fine cells splitting it
+    for (int k = 0; k < block_size; ++k) {
+        for (int j = 0; j < block_size; ++j) {
+            for (int i = 0; i < block_size; ++i) {
+                size_t index = (patch.lo[0] + i) +
+                               static_cast<size_t>(nx) * ((patch.lo[1] + j) +
+                                                          static_cast<size_t>(ny) * (patch.lo[2] + k));
+                if (obstacles[index]) continue;
+
+                for (int f = 0; f < 5; ++f) {
+                    const Field& src = *fine_fields[f];
+                    double sum = 0.0;
+                    for (int dk = 1; dk <= 2; ++dk) {
+                        for (int dj = 1; dj <= 2; ++dj) {
+                            for (int di = 1; di <= 2; ++di) {
+                                sum += src[(2*i + di) + n * ((2*j + dj) + n * (2*k + dk))];
+                            }
+                        }
+                    }
+                    (*base_fields[f])[index] = 0.125 * sum;
+                }
+            }
+        }
+    }
+}
+
+void AMRHierarchy::regrid() {
+    int num_blocks = nbx * nby * nbz;
+    std::vector<char> flags(num_blocks, 0);
+
+    #pragma omp parallel for collapse(3) schedule(dynamic)
+    for (int bk = 0; bk < nbz; ++bk) {
+        for (int bj = 0; bj < nby; ++bj) {
+            for (int bi = 0; bi < nbx; ++bi) {
+                flags[blockIndex(bi, bj, bk)] = flagBlock(bi, bj, bk);
+            }
+        }
+    }
+
+    // Keep patches on blocks that stay flagged; create the new ones from
+    // the base grid. Dropped patches were already restricted last step.
+    std::vector<Patch> new_patches;
+    std::vector<int> new_block_to_patch(num_blocks, -1);
+    for (int bk = 0; bk < nbz; ++bk) {
+        for (int bj = 0; bj < nby; ++bj) {
+            for (int bi = 0; bi < nbx; ++bi) {
+                int b = blockIndex(bi, bj, bk);
+                if (!flags[b]) continue;
+
+                if (block_to_patch[b] >= 0) {
+                    new_patches.push_back(std::move(patches[block_to_patch[b]]));
+                } else {
+                    Patch patch;
+                    patch.lo[0] = bi * block_size;
+                    patch.lo[1] = bj * block_size;
+                    patch.lo[2] = bk * block_size;
+                    patch.solver = createPatchSolver(patch.lo);
+                    fillFromBase(patch, 1.0, false);
+                    new_patches.push_back(std::move(patch));
+                }
+                new_block_to_patch[b] = static_cast<int>(new_patches.size()) - 1;
+            }
+        }
+    }
+
+    patches.swap(new_patches);
+    block_to_patch.swap(new_block_to_patch);
+}
+
+void AMRHierarchy::step() {
+    if (step_count % regrid_interval == 0) {
+        regrid();
+    }
+
+    // Keep the base state at time t for interpolating ghosts in time
+    u_old = base.getVelocityU();
+    v_old = base.getVelocityV();
+    w_old = base.getVelocityW();
+    density_old = base.getDensity();
+    temperature_old = base.getTemperature();
+    pressure_old = base.getPressure();
+
+    base.step();
+
+    // Two fine steps of dt / 2. Patches are small, so parallelism is across
+    // patches; each patch's own loops run as inactive nested regions.
+    int num_patches = static_cast<int>(patches.size());
+    for (int substep = 0; substep < 2; ++substep) {
+        double alpha = 0.5 * substep;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int p = 0; p < num_patches; ++p) {
+            fillFromBase(patches[p], alpha, true);
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int p = 0; p < num_patches; ++p) {
+            patches[p].solver->step();
+        }
+    }
+
+    // Average fine data down, then re-project the composite velocity on the
+    // base grid so the synchronised field is divergence-free again
+    #pragma omp parallel for schedule(dynamic)
+    for (int p = 0; p < num_patches; ++p) {
+        restrictPatch(patches[p]);
+    }
+    if (num_patches > 0) {
+        base.project();
+    }
+    if (base.metricsEnabled()) {
+        base.updateMetrics();
+    }
+
+    ++step_count;
+}
+
+long long AMRHierarchy::getCellCount() const {
+    long long fine_cells = 8LL * block_size * block_size * block_size;
+    return static_cast<long long>(base.getNx()) * base.getNy() * base.getNz() +
+           fine_cells * static_cast<long long>(patches.size());
+}
+
+std::vector<VTKWriter::AMRBlock> AMRHierarchy::getOutputBlocks() const {
+    std::vector<VTKWriter::AMRBlock> blocks;
+
+    const FluidSolver& coarse = base;
+    VTKWriter::AMRBlock root = {
+        0, {0, 0, 0},
+        {coarse.getNx(), coarse.getNy(), coarse.getNz()},
+        {coarse.getNx(), coarse.getNy(), coarse.getNz()},
+        {0, 0, 0},
+        &coarse.getDensity(), &coarse.getTemperature(),
+        &coarse.getVelocityU(), &coarse.getVelocityV(), &coarse.getVelocityW(),
+        &coarse.getObstacles()};
+    blocks.push_back(root);
+
+    int n = 2 * block_size + 2;
+    for (const Patch& patch : patches) {
+        const FluidSolver& fine = *patch.solver;
+        VTKWriter::AMRBlock block = {
+            1, {2 * patch.lo[0], 2 * patch.lo[1], 2 * patch.lo[2]},
+            {2 * block_size, 2 * block_size, 2 * block_size},
+            {n, n, n},
+            {1, 1, 1},
+            &fine.getDensity(), &fine.getTemperature(),
+            &fine.getVelocityU(), &fine.getVelocityV(), &fine.getVelocityW(),
+            &fine.getObstacles()};
+        blocks.push_back(block);
+    }
+    return blocks;
+}
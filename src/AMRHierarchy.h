@@ -0,0 +1,79 @@
+#pragma once
+
+#include "FluidSolver.h"
+#include "Geometry.h"
+#include "VTKWriter.h"
+#include <memory>
+#include <vector>
+
+// Two-level block-structured AMR on top of a uniform base solver.
+//
+// The base grid is tiled into cubic blocks of block_size cells. Flagged
+// blocks get a patch refined 2x in space and time: an ordinary FluidSolver
+// in External boundary mode with (2 * block_size + 2)^3 cells, the outer
+// layer being ghost cells. Ghosts are copied from neighbouring patches or
+// interpolated from the base grid (linearly in time between base steps).
+// Fine cells are cell-centred: fine cells 2c and 2c + 1 split base cell c.
+// Base emitters overlapping a block are forwarded to its patch when the
+// patch is created.
+class AMRHierarchy {
+public:
+    // Refinement criteria, evaluated per block on the base grid
+    struct Criteria {
+        int obstacle_distance = 2;       // Refine within this many base cells of an obstacle
+        double vorticity = 2.0;          // |curl u| threshold (<= 0 disables)
+        double density_gradient = 0.1;   // |grad density| threshold (<= 0 disables)
+    };
+
+    struct Patch {
+        int lo[3];                            // First base cell covered
+        std::unique_ptr<FluidSolver> solver;  // Includes the ghost layer
+    };
+
+    // geometry is re-voxelized at the fine resolution for every patch
+    AMRHierarchy(FluidSolver& base, const Geometry& geometry, int block_size);
+
+    void setCriteria(const Criteria& c) { criteria = c; }
+    void setRegridInterval(int steps) { regrid_interval = steps; }
+
+    // Advance base grid and patches by one base time step
+    void step();
+
+    // Re-evaluate the criteria and add/remove patches. Patches on blocks that
+    // stay refined keep their data.
+    void regrid();
+
+    const FluidSolver& getBase() const { return base; }
+    const std::vector<Patch>& getPatches() const { return patches; }
+
+    // Cells actually simulated (base grid plus patch interiors)
+    long long getCellCount() const;
+
+    // Base grid and patch interiors, ready for VTKWriter::writeAMR
+    std::vector<VTKWriter::AMRBlock> getOutputBlocks() const;
+
+private:
+    FluidSolver& base;
+    const Geometry& geometry;
+    int block_size;
+    int nbx, nby, nbz;             // Number of whole blocks per direction
+    Criteria criteria;
+    int regrid_interval;
+    long long step_count;
+
+    std::vector<Patch> patches;
+    std::vector<int> block_to_patch;  // Patch index per block, -1 if unrefined
+
+    // Base state at the start of the current step, for time interpolation
+    Field u_old, v_old, w_old, density_old, temperature_old, pressure_old;
+
+    int blockIndex(int bi, int bj, int bk) const { return bi + nbx * (bj + nby * bk); }
+    bool flagBlock(int bi, int bj, int bk) const;
+    std::unique_ptr<FluidSolver> createPatchSolver(const int lo[3]) const;
+
+    // Set patch cells from the base grid; alpha blends old (0) and current (1)
+    // base state. With ghosts_only, interior cells are left untouched and
+    // ghosts inside a neighbouring patch are copied from it instead.
+    void fillFromBase(Patch& patch, double alpha, bool ghosts_only);
+    void restrictPatch(const Patch& patch);
+};
@@ -0,0 +1,341 @@
+#include "Ensemble.h"
+#include "VTKWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace {
+
+// Parse a kernel CPU list such as "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+#ifdef __linux__
+// Restrict the calling thread to cpus. Threads it creates afterwards, such
+// as the members' nested OpenMP teams, inherit the mask.
+void pinThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+#endif
+
+} // namespace
+
+Ensemble::Ensemble(int nx, int ny, int nz, double dx, double dt,
+                   std::shared_ptr<FluidSolver::ObstacleData> obstacles)
+    : nx(nx), ny(ny), nz(nz), dx(dx), dt(dt), obstacles(std::move(obstacles)),
+      threads_per_member(0), member_metrics(false) {}
+
+bool Ensemble::loadSweep(const std::string& filename, std::vector<EnsembleMember>& members) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Cannot open sweep file " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    std::set<std::string> names;
+    while (std::getline(file, line)) {
+        ++line_number;
+
+        // Strip comments
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+
+        std::istringstream tokens(line);
+        EnsembleMember member;
+        if (!(tokens >> member.name)) {
+            continue;  // Blank line
+        }
+        // Members write <name>.log and <name>_output_*, so names must differ
+        if (!names.insert(member.name).second) {
+            std::cerr << filename << ":" << line_number
+                      << ": duplicate member name '" << member.name << "'" << std::endl;
+            return false;
+        }
+
+        std::string pair;
+        while (tokens >> pair) {
+            size_t eq = pair.find('=');
+            if (eq == std::string::npos) {
+                std::cerr << filename << ":" << line_number
+                          << ": expected key=value, got '" << pair << "'" << std::endl;
+                return false;
+            }
+            std::string key = pair.substr(0, eq);
+            double value = std::atof(pair.c_str() + eq + 1);
+
+            if (key == "inlet_u") member.inlet_u = value;
+            else if (key == "inlet_v") member.inlet_v = value;
+            else if (key == "inlet_w") member.inlet_w = value;
+            else if (key == "viscosity") member.viscosity = value;
+            else if (key == "thermal_diffusivity") member.thermal_diffusivity = value;
+            else if (key == "mass_diffusivity") member.mass_diffusivity = value;
+            else if (key == "source") member.source_strength = value;
+            else {
+                std::cerr << filename << ":" << line_number
+                          << ": unknown parameter '" << key << "'" << std::endl;
+                return false;
+            }
+        }
+
+        members.push_back(member);
+    }
+
+    if (members.empty()) {
+        std::cerr << "Error: Sweep file " << filename << " defines no members" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::vector<int>> Ensemble::detectNumaNodes() {
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    // One nodeN directory per NUMA node, listing its CPUs. Only CPUs this
+    // process may use count (containers, taskset).
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool have_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::vector<std::pair<int, std::vector<int>>> numbered;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+            !std::isdigit(static_cast<unsigned char>(name[4]))) {
+            continue;
+        }
+        std::ifstream list(entry.path() / "cpulist");
+        std::string text;
+        std::getline(list, text);
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(text)) {
+            if (!have_allowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty()) {  // Memory-only nodes run nothing
+            numbered.emplace_back(std::atoi(name.c_str() + 4), cpus);
+        }
+    }
+    std::sort(numbered.begin(), numbered.end());
+    for (auto& node : numbered) {
+        nodes.push_back(std::move(node.second));
+    }
+#endif
+    if (nodes.empty()) {
+        nodes.emplace_back();  // Unknown topology: one node, no pinning
+    }
+    return nodes;
+}
+
+Ensemble::Schedule Ensemble::makeSchedule(int num_members) const {
+    Schedule schedule;
+    std::vector<std::vector<int>> nodes = detectNumaNodes();
+    schedule.numa_nodes = static_cast<int>(nodes.size());
+
+#ifdef _OPENMP
+    int total_threads = omp_get_max_threads();
+#else
+    int total_threads = 1;
+#endif
+
+    // Independent members scale perfectly while a single solver does not, so
+    // by default spread the cores over as many concurrent members as possible
+    schedule.threads_per_slot = threads_per_member > 0
+        ? std::min(threads_per_member, total_threads)
+        : std::max(1, total_threads / num_members);
+    schedule.slots = std::max(1, std::min(num_members, total_threads / schedule.threads_per_slot));
+
+    // Keep every NUMA node equally loaded so no node's memory bandwidth
+    // becomes the bottleneck for the whole batch, unless that would take
+    // another wave of members to finish
+    int balanced = schedule.slots - schedule.slots % schedule.numa_nodes;
+    auto waves = [num_members](int slots) { return (num_members + slots - 1) / slots; };
+    if (balanced > 0 && balanced < schedule.slots && waves(balanced) == waves(schedule.slots)) {
+        schedule.slots = balanced;
+        if (threads_per_member <= 0) {
+            schedule.threads_per_slot = std::max(1, total_threads / schedule.slots);
+        }
+    }
+
+    // Pin each slot to its node unless the user placed threads through
+    // OpenMP, so members' fields are first-touched in local memory. Slots
+    // on the same node get disjoint shares of its CPUs where there are enough.
+    if (std::getenv("OMP_PLACES") || std::getenv("OMP_PROC_BIND") || nodes[0].empty()) {
+        return schedule;
+    }
+    int num_nodes = schedule.numa_nodes;
+    schedule.slot_cpus.resize(schedule.slots);
+    for (int s = 0; s < schedule.slots; ++s) {
+        const std::vector<int>& cpus = nodes[s % num_nodes];
+        int node_slots = (schedule.slots - s % num_nodes + num_nodes - 1) / num_nodes;
+        int rank = s / num_nodes;
+        size_t count = cpus.size();
+        if (count < static_cast<size_t>(node_slots)) {
+            schedule.slot_cpus[s] = cpus;
+        } else {
+            schedule.slot_cpus[s].assign(cpus.begin() + rank * count / node_slots,
+                                         cpus.begin() + (rank + 1) * count / node_slots);
+        }
+    }
+    return schedule;
+}
+
+void Ensemble::runMember(const EnsembleMember& member, int num_steps,
+                         int output_interval, const SetupCallback& setup) {
+    // Constructed on the worker thread so that first-touch places the
+    // member's fields on the NUMA node it runs on
+    FluidSolver solver(nx, ny, nz, dx, dt);
+    if (!solver.shareObstacles(obstacles)) {
+        #pragma omp critical(ensemble_report)
+        {
+            std::cerr << "Error: Member " << member.name
+                      << " cannot share the ensemble's obstacles" << std::endl;
+        }
+        return;
+    }
+    solver.setInletVelocity(member.inlet_u, member.inlet_v, member.inlet_w);
+    if (member.viscosity >= 0) solver.setViscosity(member.viscosity);
+    if (member.thermal_diffusivity >= 0) solver.setThermalDiffusivity(member.thermal_diffusivity);
+    if (member.mass_diffusivity >= 0) solver.setMassDiffusivity(member.mass_diffusivity);
+    solver.enableMetrics(member_metrics);
+    setup(solver, member);
+
+    std::ofstream log(member.name + ".log");
+    log << (member_metrics ? "# step time_ms du_l2 du_max div_l2 div_max" : "# step time_ms") << std::endl;
+
+    auto member_start = std::chrono::high_resolution_clock::now();
+    for (int step = 0; step < num_steps; ++step) {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        solver.step();
+        auto end_time = std::chrono::high_resolution_clock::now();
+
+        double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        log << step << " " << std::fixed << std::setprecision(3) << elapsed_ms;
+        if (member_metrics) {
+            const FluidSolver::StepMetrics& metrics = solver.getMetrics();
+            log << std::scientific << std::setprecision(4)
+                << " " << metrics.velocity_change_l2 << " " << metrics.velocity_change_max
+                << " " << metrics.divergence_l2 << " " << metrics.divergence_max;
+        }
+        log << "\n";
+
+        if (step % output_interval == 0) {
+            std::ostringstream filename;
+            filename << member.name << "_output_" << std::setw(4) << std::setfill('0') << step << ".vti";
+
+            VTKWriter::writeVTK(filename.str(),
+                                solver.getNx(), solver.getNy(), solver.getNz(),
+                                solver.getDx(),
+                                solver.getDensity(),
+                                solver.getTemperature(),
+                                solver.getVelocityU(),
+                                solver.getVelocityV(),
+                                solver.getVelocityW(),
+                                solver.getObstacles());
+        }
+    }
+    auto member_end = std::chrono::high_resolution_clock::now();
+    double total_s = std::chrono::duration<double>(member_end - member_start).count();
+
+    #pragma omp critical(ensemble_report)
+    {
+        std::cout << "Member " << member.name << " finished in "
+                  << std::fixed << std::setprecision(2) << total_s << " s" << std::endl;
+    }
+}
+
+void Ensemble::run(const std::vector<EnsembleMember>& members, int num_steps,
+                   int output_interval, const SetupCallback& setup) {
+    int num_members = static_cast<int>(members.size());
+    Schedule schedule = makeSchedule(num_members);
+
+    std::cout << "Ensemble: " << num_members << " members, "
+              << schedule.slots << " concurrent x " << schedule.threads_per_slot
+              << " threads, " << schedule.numa_nodes << " NUMA node(s), "
+              << (schedule.slot_cpus.empty() ? "placement left to OpenMP" : "pinned per node")
+              << std::endl;
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+#ifdef _OPENMP
+    // Outer level spreads members over the machine, inner level is the
+    // solver's own loops. Each outer thread pins itself to its slot's CPUs
+    // before its member creates the inner team; with OMP_PLACES or
+    // OMP_PROC_BIND set, OpenMP binding is used instead.
+    omp_set_max_active_levels(2);
+    #pragma omp parallel num_threads(schedule.slots) proc_bind(spread)
+    {
+#ifdef __linux__
+        cpu_set_t original;
+        bool pinned = !schedule.slot_cpus.empty() &&
+                      sched_getaffinity(0, sizeof(original), &original) == 0;
+        if (pinned) {
+            pinThread(schedule.slot_cpus[omp_get_thread_num()]);
+        }
+#endif
+        omp_set_num_threads(schedule.threads_per_slot);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int m = 0; m < num_members; ++m) {
+            runMember(members[m], num_steps, output_interval, setup);
+        }
+
+#ifdef __linux__
+        // Pool threads, including the caller's, outlive the ensemble
+        if (pinned) {
+            sched_setaffinity(0, sizeof(original), &original);
+        }
+#endif
+    }
+#else
+    for (int m = 0; m < num_members; ++m) {
+        runMember(members[m], num_steps, output_interval, setup);
+    }
+#endif
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    double total_s = std::chrono::duration<double>(end_time - start_time).count();
+    double cells = static_cast<double>(nx) * ny * nz;
+
+    std::cout << "Ensemble complete in " << std::fixed << std::setprecision(2) << total_s << " s ("
+              << std::setprecision(1) << cells * num_steps * num_members / total_s / 1e6
+              << " Mcell-steps/s)" << std::endl;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "FluidSolver.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One variant of a parameter sweep. Negative physical parameters mean
+// "keep the solver default".
+struct EnsembleMember {
+    std::string name;
+    double inlet_u = 5.0;
+    double inlet_v = 0.0;
+    double inlet_w = 0.0;
+    double viscosity = -1.0;
+    double thermal_diffusivity = -1.0;
+    double mass_diffusivity = -1.0;
+    double source_strength = 1.0;  // Multiplier on the smoke source rates
+};
+
+// Runs many FluidSolver instances in one process. All members share one
+// copy of the obstacle data; each writes its own VTK series
+// (<name>_output_NNNN.vti) and step log (<name>.log).
+class Ensemble {
+public:
+    // Called once for every member before its first step, e.g. to
+    // register smoke emitters
+    using SetupCallback = std::function<void(FluidSolver&, const EnsembleMember&)>;
+
+    // Members run on an nx*ny*nz grid and share obstacles, which must come
+    // from FluidSolver::buildObstacles() for that grid
+    Ensemble(int nx, int ny, int nz, double dx, double dt,
+             std::shared_ptr<FluidSolver::ObstacleData> obstacles);
+
+    // Read a sweep specification: one member per line, a name followed by
+    // key=value pairs (inlet_u, inlet_v, inlet_w, viscosity,
+    // thermal_diffusivity, mass_diffusivity, source). '#' starts a comment.
+    static bool loadSweep(const std::string& filename, std::vector<EnsembleMember>& members);
+
+    // Threads given to each member; 0 picks automatically
+    void setThreadsPerMember(int threads) { threads_per_member = threads; }
+
+    // Add convergence metrics to the member logs (costs each member three
+    // extra fields and a sweep per step)
+    void setMemberMetrics(bool enable) { member_metrics = enable; }
+
+    void run(const std::vector<EnsembleMember>& members, int num_steps,
+             int output_interval, const SetupCallback& setup);
+
+private:
+    int nx, ny, nz;
+    double dx, dt;
+    std::shared_ptr<FluidSolver::ObstacleData> obstacles;
+    int threads_per_member;
+    bool member_metrics;
+
+    // How members are packed onto the machine. Slot s runs on NUMA node
+    // s % numa_nodes; slots sharing a node split its CPUs between them.
+    struct Schedule {
+        int slots;              // Members running concurrently
+        int threads_per_slot;   // OpenMP threads inside each member
+        int numa_nodes;
+        std::vector<std::vector<int>> slot_cpus;  // CPUs per slot; empty if not pinned
+    };
+    Schedule makeSchedule(int num_members) const;
+
+    // CPUs of each NUMA node the process may run on; a single empty entry
+    // if the topology is unknown
+    static std::vector<std::vector<int>> detectNumaNodes();
+
+    void runMember(const EnsembleMember& member, int num_steps,
+                   int output_interval, const SetupCallback& setup);
+};
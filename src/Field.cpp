@@ -0,0 +1,171 @@
+#include "Field.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#define FIELD_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::string spill_directory;
+
+// Small fields (e.g. AMR patches) are not worth a file of their own
+const size_t kMinMappedBytes = 1 << 20;
+
+#ifdef FIELD_HAVE_MMAP
+size_t pageSize() {
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page;
+}
+
+// Page-aligned byte range covering elements [first, first + n)
+void pageRange(const double* values, size_t first, size_t n, char*& start, size_t& length) {
+    size_t page = pageSize();
+    uintptr_t begin = reinterpret_cast<uintptr_t>(values + first) & ~(page - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(values + first + n);
+    start = reinterpret_cast<char*>(begin);
+    length = end - begin;
+}
+#endif
+
+} // namespace
+
+void Field::setSpillDirectory(const std::string& directory) {
+    spill_directory = directory;
+}
+
+const std::string& Field::getSpillDirectory() {
+    return spill_directory;
+}
+
+Field::Field(size_t size, double value) {
+    allocate(size);
+    // Fresh file mappings already read as zero; don't touch every page
+    if (!isMapped() || value != 0.0) {
+        std::fill(values, values + count, value);
+    }
+}
+
+Field::Field(const Field& other) {
+    allocate(other.count);
+    std::copy(other.values, other.values + other.count, values);
+}
+
+Field::Field(Field&& other) noexcept {
+    swap(other);
+}
+
+Field::~Field() {
+    deallocate();
+}
+
+Field& Field::operator=(const Field& other) {
+    if (this != &other) {
+        if (count != other.count) {
+            deallocate();
+            allocate(other.count);
+        }
+        std::copy(other.values, other.values + other.count, values);
+    }
+    return *this;
+}
+
+Field& Field::operator=(Field&& other) noexcept {
+    swap(other);
+    return *this;
+}
+
+void Field::swap(Field& other) noexcept {
+    std::swap(values, other.values);
+    std::swap(count, other.count);
+    std::swap(fd, other.fd);
+}
+
+void Field::allocate(size_t size) {
+    count = size;
+    if (size == 0) {
+        return;
+    }
+    size_t bytes = size * sizeof(double);
+
+#ifdef FIELD_HAVE_MMAP
+    if (!spill_directory.empty() && bytes >= kMinMappedBytes) {
+        // The file is unlinked straight away, so it disappears with the
+        // mapping even if the process dies
+        std::string path = spill_directory + "/fluid_field_XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+
+        int file = mkstemp(name.data());
+        if (file >= 0) {
+            unlink(name.data());
+            void* mapping = MAP_FAILED;
+            if (ftruncate(file, static_cast<off_t>(bytes)) == 0) {
+                mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            }
+            if (mapping != MAP_FAILED) {
+                values = static_cast<double*>(mapping);
+                fd = file;
+                return;
+            }
+            close(file);
+        }
+        std::cerr << "Warning: Cannot create field file in " << spill_directory
+                  << ", using memory instead" << std::endl;
+    }
+#endif
+
+    values = new double[size];
+}
+
+void Field::deallocate() {
+#ifdef FIELD_HAVE_MMAP
+    if (fd >= 0) {
+        munmap(values, count * sizeof(double));
+        close(fd);
+        fd = -1;
+        values = nullptr;
+        count = 0;
+        return;
+    }
+#endif
+    delete[] values;
+    values = nullptr;
+    count = 0;
+}
+
+void Field::prefetch(size_t first, size_t n) const {
+#ifdef FIELD_HAVE_MMAP
+    if (fd < 0 || n == 0) return;
+    char* start;
+    size_t length;
+    pageRange(values, first, n, start, length);
+    madvise(start, length, MADV_WILLNEED);
+#else
+    (void)first;
+    (void)n;
+#endif
+}
+
+void Field::release(size_t first, size_t n) const {
+#ifdef FIELD_HAVE_MMAP
+    if (fd < 0 || n == 0) return;
+    char* start;
+    size_t length;
+    pageRange(values, first, n, start, length);
+    // Queue dirty pages for writeback, then unmap them from this process.
+    // The data stays in the shared file, so later accesses read it back.
+    msync(start, length, MS_ASYNC);
+    madvise(start, length, MADV_DONTNEED);
+#else
+    (void)first;
+    (void)n;
+#endif
+}
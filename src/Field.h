@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Contiguous array of doubles holding one solver field.
+//
+// Normally backed by heap memory. Once a spill directory is set, large
+// fields created afterwards are instead shared mappings of (unlinked)
+// files in that directory, so their pages can be written back and dropped
+// from memory. FluidSolver uses prefetch()/release() to keep only a window
+// of z-slabs resident.
+class Field {
+public:
+    Field() = default;
+    explicit Field(size_t size, double value = 0.0);
+    Field(const Field& other);
+    Field(Field&& other) noexcept;
+    ~Field();
+
+    Field& operator=(const Field& other);
+    Field& operator=(Field&& other) noexcept;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    double* data() { return values; }
+    const double* data() const { return values; }
+    double* begin() { return values; }
+    double* end() { return values + count; }
+    const double* begin() const { return values; }
+    const double* end() const { return values + count; }
+    double& operator[](size_t i) { return values[i]; }
+    const double& operator[](size_t i) const { return values[i]; }
+
+    void swap(Field& other) noexcept;
+
+    // True if the data lives in a file mapping rather than on the heap
+    bool isMapped() const { return fd >= 0; }
+
+    // Paging hints for elements [first, first + n). No-ops for heap fields.
+    // prefetch() starts reading the range in; release() starts writing it
+    // back and drops it from the process's resident set.
+    void prefetch(size_t first, size_t n) const;
+    void release(size_t first, size_t n) const;
+
+    // Directory for file-backed fields; empty (the default) keeps all
+    // fields on the heap. Affects fields allocated afterwards.
+    static void setSpillDirectory(const std::string& directory);
+    static const std::string& getSpillDirectory();
+
+private:
+    double* values = nullptr;
+    size_t count = 0;
+    int fd = -1;           // Backing file when mapped
+
+    void allocate(size_t size);
+    void deallocate();
+};
@@ -5,7 +5,8 @@
 #include <cstring>
 
 FluidSolver::FluidSolver(int nx, int ny, int nz, double dx, double dt)
-    : nx(nx), ny(ny), nz(nz), dx(dx), dt(dt),
+    : nx(nx), ny(ny), nz(nz), dx(dx), dt(dt), step_count(0),
+      boundary_mode(BoundaryMode::WindTunnel),
       viscosity(0.15),               // Kinematic viscosity (momentum diffusion)
       thermal_diffusivity(0.25),     // Thermal diffusivity (Pr = nu/alpha ~ 0.6 for air)
       mass_diffusivity(0.5),         // Mass diffusivity for smoke (high for fast spreading)
@@ -14,47 +15,387 @@ FluidSolver::FluidSolver(int nx, int ny, int nz, double dx, double dt)
       ambient_temperature(0.0),
       inlet_velocity_u(5.0),         // Default inlet velocity in x-direction
       inlet_velocity_v(0.0),
-      inlet_velocity_w(0.0) {
+      inlet_velocity_w(0.0),
+      metrics_deferred(false),
+      window_bytes(256u << 20),      // Resident budget per slab sweep when out-of-core
+      advect_reach(1) {
     
-    int size = nx * ny * nz;
+    size_t size = static_cast<size_t>(nx) * ny * nz;
     
-    u.resize(size, 0.0);
-    v.resize(size, 0.0);
-    w.resize(size, 0.0);
-    u_prev.resize(size, 0.0);
-    v_prev.resize(size, 0.0);
-    w_prev.resize(size, 0.0);
+    u = Field(size);
+    v = Field(size);
+    w = Field(size);
+    u_prev = Field(size);
+    v_prev = Field(size);
+    w_prev = Field(size);
     
-    density.resize(size, 0.0);
-    density_prev.resize(size, 0.0);
+    density = Field(size);
+    density_prev = Field(size);
     
-    temperature.resize(size, ambient_temperature);
-    temperature_prev.resize(size, ambient_temperature);
+    temperature = Field(size, ambient_temperature);
+    temperature_prev = Field(size, ambient_temperature);
     
-    pressure.resize(size, 0.0);
-    obstacles.resize(size, false);
+    pressure = Field(size);
+    
+    jacobi_scratch = Field(size);
+    div = Field(size);
+    
+    // Fields are file-backed if a spill directory was set beforehand
+    out_of_core = u.isMapped();
+    
+    obstacle_data = std::make_shared<ObstacleData>();
+    obstacle_data->nx = nx;
+    obstacle_data->ny = ny;
+    obstacle_data->nz = nz;
+    obstacle_data->mask.resize(size, false);
 }
 
-int FluidSolver::idx(int i, int j, int k) const {
-    return i + nx * (j + ny * k);
+size_t FluidSolver::idx(int i, int j, int k) const {
+    return i + static_cast<size_t>(nx) * (j + static_cast<size_t>(ny) * k);
 }
 
 bool FluidSolver::isValid(int i, int j, int k) const {
     return i >= 0 && i < nx && j >= 0 && j < ny && k >= 0 && k < nz;
 }
 
+void FluidSolver::forEachSlab(int k_begin, int k_end, int halo,
+                              std::initializer_list<const Field*> fields,
+                              const std::function<void(int, int)>& body) {
+    if (!out_of_core) {
+        body(k_begin, k_end);
+        return;
+    }
+    
+    // Paging hints only: a kernel reaching outside the prefetched planes
+    // still reads correct data, it just waits for the page fault
+    size_t plane = static_cast<size_t>(nx) * ny;
+    size_t plane_bytes = plane * sizeof(double) * std::max<size_t>(1, fields.size());
+    
+    // Half the window holds the current slab plus halo, the other half the
+    // prefetched next one
+    int depth = static_cast<int>(window_bytes / plane_bytes) - 2 * halo;
+    depth = std::max(1, depth / 2);
+    
+    auto hint = [&](int k0, int k1, bool fetch) {
+        k0 = std::max(k0, 0);
+        k1 = std::min(k1, nz);
+        if (k0 >= k1) return;
+        for (const Field* field : fields) {
+            if (fetch) {
+                field->prefetch(k0 * plane, (k1 - k0) * plane);
+            } else {
+                field->release(k0 * plane, (k1 - k0) * plane);
+            }
+        }
+    };
+    
+    hint(k_begin - halo, std::min(k_begin + depth, k_end) + halo, true);
+    int released = k_begin - halo;  // Planes below this are already dropped
+    
+    for (int k0 = k_begin; k0 < k_end; k0 += depth) {
+        int k1 = std::min(k0 + depth, k_end);
+        if (k1 < k_end) {
+            hint(k1 + halo, std::min(k1 + depth, k_end) + halo, true);
+        }
+        
+        body(k0, k1);
+        
+        // The next slab still needs the halo planes below it
+        hint(released, k1 - halo, false);
+        released = std::max(released, k1 - halo);
+    }
+    hint(released, k_end + halo, false);
+}
+
+void FluidSolver::copyField(Field& dst, const Field& src) {
+    size_t plane = static_cast<size_t>(nx) * ny;
+    forEachSlab(0, nz, 0, {&dst, &src}, [&](int k0, int k1) {
+        #pragma omp parallel for
+        for (int k = k0; k < k1; ++k) {
+            std::copy(src.begin() + k * plane, src.begin() + (k + 1) * plane,
+                      dst.begin() + k * plane);
+        }
+    });
+}
+
+void FluidSolver::updateAdvectionReach() {
+    // Planes a backtrace can cross, plus one for the interpolation stencil.
+    // Used as the advection halo so those planes are prefetched.
+    double max_w = 0.0;
+    size_t plane = static_cast<size_t>(nx) * ny;
+    forEachSlab(0, nz, 0, {&w_prev}, [&](int k0, int k1) {
+        size_t first = k0 * plane, last = k1 * plane;
+        #pragma omp parallel for reduction(max:max_w)
+        for (size_t index = first; index < last; ++index) {
+            max_w = std::max(max_w, std::abs(w_prev[index]));
+        }
+    });
+    advect_reach = static_cast<int>(std::ceil(max_w * dt / dx)) + 1;
+}
+
+void FluidSolver::releaseMemory() {
+    if (!out_of_core) {
+        return;
+    }
+    for (Field* field : {&u, &v, &w, &u_prev, &v_prev, &w_prev, &density, &density_prev,
+                         &temperature, &temperature_prev, &pressure, &jacobi_scratch, &div,
+                         &u_last, &v_last, &w_last}) {
+        field->release(0, field->size());
+    }
+}
+
+void FluidSolver::enableMetrics(bool enable) {
+    if (enable == metricsEnabled()) {
+        return;
+    }
+    if (!enable) {
+        u_last = Field();
+        v_last = Field();
+        w_last = Field();
+        metrics = StepMetrics();
+        return;
+    }
+    
+    // Start from the current state so the first step reports a real change
+    size_t size = static_cast<size_t>(nx) * ny * nz;
+    u_last = Field(size);
+    v_last = Field(size);
+    w_last = Field(size);
+    copyField(u_last, u);
+    copyField(v_last, v);
+    copyField(w_last, w);
+}
+
+void FluidSolver::updateMetrics() {
+    // One fused sweep: velocity change against the previous step (which
+    // also refreshes the copy) and the divergence of the final velocity
+    const std::vector<bool>& obstacles = obstacle_data->mask;
+    double change_sq = 0.0, change_max = 0.0, speed_sq = 0.0, speed_max = 0.0;
+    double div_sq = 0.0, div_max = 0.0;
+    long long fluid_cells = 0;
+    double inv_2dx = 0.5 / dx;
+    
+    forEachSlab(0, nz, 1, {&u, &v, &w, &u_last, &v_last, &w_last}, [&](int k0, int k1) {
+        #pragma omp parallel for collapse(2) reduction(+:change_sq, speed_sq, div_sq, fluid_cells) \
+                                             reduction(max:change_max, speed_max, div_max)
+        for (int k = k0; k < k1; ++k) {
+            for (int j = 0; j < ny; ++j) {
+                for (int i = 0; i < nx; ++i) {
+                    size_t index = idx(i, j, k);
+                    
+                    double du = u[index] - u_last[index];
+                    double dv = v[index] - v_last[index];
+                    double dw = w[index] - w_last[index];
+                    double change = du * du + dv * dv + dw * dw;
+                    double speed = u[index] * u[index] + v[index] * v[index] + w[index] * w[index];
+                    change_sq += change;
+                    speed_sq += speed;
+                    change_max = std::max(change_max, change);
+                    speed_max = std::max(speed_max, speed);
+                    
+                    u_last[index] = u[index];
+                    v_last[index] = v[index];
+                    w_last[index] = w[index];
+                    
+                    if (i == 0 || i == nx - 1 || j == 0 || j == ny - 1 || k == 0 || k == nz - 1 ||
+                        obstacles[index]) {
+                        continue;
+                    }
+                    
+                    double divergence = inv_2dx * (
+                        u[idx(i+1, j, k)] - u[idx(i-1, j, k)] +
+                        v[idx(i, j+1, k)] - v[idx(i, j-1, k)] +
+                        w[idx(i, j, k+1)] - w[idx(i, j, k-1)]);
+                    div_sq += divergence * divergence;
+                    div_max = std::max(div_max, std::abs(divergence));
+                    ++fluid_cells;
+                }
+            }
+        }
+    });
+    
+    metrics.velocity_change_l2 = speed_sq > 0.0 ? std::sqrt(change_sq / speed_sq) : 0.0;
+    metrics.velocity_change_max = speed_max > 0.0 ? std::sqrt(change_max / speed_max) : 0.0;
+    metrics.divergence_l2 = fluid_cells > 0 ? std::sqrt(div_sq / fluid_cells) : 0.0;
+    metrics.divergence_max = div_max;
+}
+
 void FluidSolver::addSource(int x, int y, int z, double dens, double temp) {
     if (isValid(x, y, z)) {
-        int index = idx(x, y, z);
+        size_t index = idx(x, y, z);
         density[index] += dens;
         temperature[index] += temp;
     }
 }
 
+int FluidSolver::addEmitter(Emitter emitter, double density_rate, double temperature_rate,
+                            double start_time, double end_time) {
+    emitter.density_rate = density_rate;
+    emitter.temperature_rate = temperature_rate;
+    emitter.start_time = start_time;
+    emitter.end_time = end_time;
+    emitters.push_back(std::move(emitter));
+    return static_cast<int>(emitters.size()) - 1;
+}
+
+int FluidSolver::addBoxEmitter(int x0, int y0, int z0, int x1, int y1, int z1,
+                               double density_rate, double temperature_rate,
+                               double start_time, double end_time) {
+    // Clip to the grid
+    x0 = std::max(x0, 0); x1 = std::min(x1, nx);
+    y0 = std::max(y0, 0); y1 = std::min(y1, ny);
+    z0 = std::max(z0, 0); z1 = std::min(z1, nz);
+    
+    // One span per row of the box
+    Emitter emitter;
+    if (x0 < x1) {
+        for (int k = z0; k < z1; ++k) {
+            for (int j = y0; j < y1; ++j) {
+                emitter.spans.emplace_back(idx(x0, j, k), x1 - x0);
+            }
+        }
+    }
+    return addEmitter(std::move(emitter), density_rate, temperature_rate, start_time, end_time);
+}
+
+int FluidSolver::addSphereEmitter(double cx, double cy, double cz, double radius,
+                                  double density_rate, double temperature_rate,
+                                  double start_time, double end_time) {
+    Emitter emitter;
+    int k0 = std::max(0, (int)std::ceil(cz - radius)), k1 = std::min(nz - 1, (int)std::floor(cz + radius));
+    int j0 = std::max(0, (int)std::ceil(cy - radius)), j1 = std::min(ny - 1, (int)std::floor(cy + radius));
+    int i0 = std::max(0, (int)std::ceil(cx - radius)), i1 = std::min(nx - 1, (int)std::floor(cx + radius));
+    
+    for (int k = k0; k <= k1; ++k) {
+        for (int j = j0; j <= j1; ++j) {
+            // Cells of this row strictly inside the sphere form one run
+            double r2 = radius * radius - (j - cy) * (j - cy) - (k - cz) * (k - cz);
+            int first = -1, last = -1;
+            for (int i = i0; i <= i1; ++i) {
+                if ((i - cx) * (i - cx) < r2) {
+                    if (first < 0) first = i;
+                    last = i;
+                }
+            }
+            if (first >= 0) {
+                emitter.spans.emplace_back(idx(first, j, k), last - first + 1);
+            }
+        }
+    }
+    return addEmitter(std::move(emitter), density_rate, temperature_rate, start_time, end_time);
+}
+
+int FluidSolver::addMaskEmitter(const std::vector<uint8_t>& mask,
+                                double density_rate, double temperature_rate,
+                                double start_time, double end_time) {
+    size_t plane = static_cast<size_t>(nx) * ny;
+    size_t size = plane * nz;
+    if (mask.size() != size) {
+        return -1;
+    }
+    
+    Emitter emitter;
+    
+    // Runs of consecutive marked cells, split at z-planes
+    for (size_t n = 0; n < size; ) {
+        if (!mask[n]) { ++n; continue; }
+        size_t first = n++;
+        while (n < size && mask[n] && n % plane != 0) ++n;
+        emitter.spans.emplace_back(first, static_cast<int>(n - first));
+    }
+    return addEmitter(std::move(emitter), density_rate, temperature_rate, start_time, end_time);
+}
+
+void FluidSolver::setEmitterSchedule(int id, double start_time, double end_time) {
+    if (id >= 0 && id < static_cast<int>(emitters.size())) {
+        emitters[id].start_time = start_time;
+        emitters[id].end_time = end_time;
+    }
+}
+
 void FluidSolver::setObstacle(int x, int y, int z, bool is_obstacle) {
     if (isValid(x, y, z)) {
-        obstacles[idx(x, y, z)] = is_obstacle;
+        // Copy-on-write: never modify geometry another solver is using
+        if (obstacle_data.use_count() > 1) {
+            obstacle_data = std::make_shared<ObstacleData>(*obstacle_data);
+        }
+        obstacle_data->mask[idx(x, y, z)] = is_obstacle;
+        obstacle_data->dirty = true;
+    }
+}
+
+bool FluidSolver::setObstacleMask(const std::vector<uint8_t>& mask) {
+    if (mask.size() != obstacle_data->mask.size()) {
+        return false;
+    }
+    
+    // Always start from fresh data so a shared mask is left untouched
+    auto data = std::make_shared<ObstacleData>();
+    data->nx = nx;
+    data->ny = ny;
+    data->nz = nz;
+    data->mask.assign(mask.begin(), mask.end());
+    obstacle_data = data;
+    return true;
+}
+
+std::shared_ptr<FluidSolver::ObstacleData> FluidSolver::buildObstacles(
+        int nx, int ny, int nz, const std::vector<uint8_t>& mask) {
+    if (mask.size() != static_cast<size_t>(nx) * ny * nz) {
+        return nullptr;
+    }
+    auto data = std::make_shared<ObstacleData>();
+    data->nx = nx;
+    data->ny = ny;
+    data->nz = nz;
+    data->mask.assign(mask.begin(), mask.end());
+    buildDragCells(*data);
+    return data;
+}
+
+bool FluidSolver::shareObstacles(const std::shared_ptr<ObstacleData>& data) {
+    // Dirty data would be rebuilt by whichever sharing solver steps first,
+    // concurrently with the others
+    if (!data || data->dirty || data->nx != nx || data->ny != ny || data->nz != nz) {
+        return false;
+    }
+    obstacle_data = data;
+    return true;
+}
+
+void FluidSolver::updateObstacleData() {
+    if (obstacle_data->dirty) {
+        buildDragCells(*obstacle_data);
+    }
+}
+
+void FluidSolver::buildDragCells(ObstacleData& data) {
+    int nx = data.nx, ny = data.ny, nz = data.nz;
+    auto idx = [nx, ny](int i, int j, int k) {
+        return i + static_cast<size_t>(nx) * (j + static_cast<size_t>(ny) * k);
+    };
+    const std::vector<bool>& obstacles = data.mask;
+    std::vector<size_t>& drag_cells = data.drag_cells;
+    drag_cells.clear();
+    
+    // Collect fluid cells touching an obstacle face; these are the only
+    // cells applyObstacleDrag() modifies
+    for (int k = 1; k < nz - 1; ++k) {
+        for (int j = 1; j < ny - 1; ++j) {
+            for (int i = 1; i < nx - 1; ++i) {
+                size_t index = idx(i, j, k);
+                if (obstacles[index]) continue;
+                
+                if (obstacles[idx(i-1, j, k)] || obstacles[idx(i+1, j, k)] ||
+                    obstacles[idx(i, j-1, k)] || obstacles[idx(i, j+1, k)] ||
+                    obstacles[idx(i, j, k-1)] || obstacles[idx(i, j, k+1)]) {
+                    drag_cells.push_back(index);
+                }
+            }
+        }
     }
+    
+    data.dirty = false;
 }
 
 void FluidSolver::setInletVelocity(double inlet_u, double inlet_v, double inlet_w) {
@@ -64,15 +405,18 @@ void FluidSolver::setInletVelocity(double inlet_u, double inlet_v, double inlet_
 }
 
 void FluidSolver::step() {
+    // Refresh obstacle cell lists if the geometry changed
+    updateObstacleData();
+    
     // Save previous state
-    u_prev = u;
-    v_prev = v;
-    w_prev = w;
-    density_prev = density;
-    temperature_prev = temperature;
+    copyField(u_prev, u);
+    copyField(v_prev, v);
+    copyField(w_prev, w);
+    copyField(density_prev, density);
+    copyField(temperature_prev, temperature);
     
-    // Apply buoyancy force from temperature
-    applyBuoyancy();
+    // Inject emitter smoke and apply buoyancy force from temperature
+    applySourcesAndBuoyancy();
     
     // Diffuse velocity
     diffuse(u, u_prev, viscosity);
@@ -82,9 +426,13 @@ void FluidSolver::step() {
     // Project to make velocity field divergence-free
     project();
     
-    u_prev = u;
-    v_prev = v;
-    w_prev = w;
+    copyField(u_prev, u);
+    copyField(v_prev, v);
+    copyField(w_prev, w);
+    
+    if (out_of_core) {
+        updateAdvectionReach();
+    }
     
     // Advect velocity
     advect(u, u_prev);
@@ -99,36 +447,84 @@ void FluidSolver::step() {
     
     // Diffuse and advect density (with mass diffusivity)
     diffuse(density, density_prev, mass_diffusivity);
-    density_prev = density;
+    copyField(density_prev, density);
     advect(density, density_prev);
     
     // Diffuse and advect temperature (with thermal diffusivity)
     diffuse(temperature, temperature_prev, thermal_diffusivity);
-    temperature_prev = temperature;
+    copyField(temperature_prev, temperature);
     advect(temperature, temperature_prev);
     
     // Apply boundary conditions
     applyBoundaryConditions();
+    
+    if (metricsEnabled() && !metrics_deferred) {
+        updateMetrics();
+    }
+    
+    ++step_count;
 }
 
-void FluidSolver::applyBuoyancy() {
+void FluidSolver::applySourcesAndBuoyancy() {
     // Boussinesq approximation: F_buoyancy = g * β * (T - T₀)
     // Where: g = gravity, β = thermal expansion coefficient
     // This assumes density variations are small except in buoyancy term
-    #pragma omp parallel for collapse(3)
-    for (int k = 1; k < nz - 1; ++k) {
-        for (int j = 1; j < ny - 1; ++j) {
-            for (int i = 1; i < nx - 1; ++i) {
-                int index = idx(i, j, k);
-                if (!obstacles[index]) {
-                    // Buoyancy force acts upward (in j direction - y-axis is vertical)
-                    // Note: j-direction (y-axis) is vertical in this simulation
-                    double temp_diff = temperature[index] - ambient_temperature;
-                    v[index] += dt * gravity * thermal_expansion * temp_diff;
+    const std::vector<bool>& obstacles = obstacle_data->mask;
+    double time = getTime();
+    size_t plane = static_cast<size_t>(nx) * ny;
+    
+    forEachSlab(0, nz, 0, {&density, &density_prev, &temperature, &temperature_prev, &v},
+                [&](int k0, int k1) {
+        int kb = std::max(k0, 1), ke = std::min(k1, nz - 1);
+        
+        #pragma omp parallel
+        {
+            // Emitters run after the previous state was saved, so they add to
+            // both copies - the same result as addSource() before step().
+            // Emitters may overlap each other, hence the barrier after each one.
+            for (const Emitter& emitter : emitters) {
+                if (time < emitter.start_time || time >= emitter.end_time) continue;
+                
+                double dens = emitter.density_rate * dt;
+                double temp = emitter.temperature_rate * dt;
+                
+                // Spans starting inside this slab
+                auto first_span = std::lower_bound(emitter.spans.begin(), emitter.spans.end(),
+                                                   std::make_pair(k0 * plane, 0));
+                auto last_span = std::lower_bound(first_span, emitter.spans.end(),
+                                                  std::make_pair(k1 * plane, 0));
+                size_t span_offset = first_span - emitter.spans.begin();
+                int num_spans = static_cast<int>(last_span - first_span);
+                
+                #pragma omp for
+                for (int n = 0; n < num_spans; ++n) {
+                    size_t first = emitter.spans[span_offset + n].first;
+                    size_t last = first + emitter.spans[span_offset + n].second;
+                    for (size_t index = first; index < last; ++index) {
+                        density[index] += dens;
+                        density_prev[index] += dens;
+                        temperature[index] += temp;
+                        temperature_prev[index] += temp;
+                    }
+                }
+            }
+            
+            #pragma omp for collapse(3)
+            for (int k = kb; k < ke; ++k) {
+                for (int j = 1; j < ny - 1; ++j) {
+                    for (int i = 1; i < nx - 1; ++i) {
+                        size_t index = idx(i, j, k);
+                        if (!obstacles[index]) {
+                            // Buoyancy force acts upward (in j direction - y-axis is vertical)
+                            // Note: j-direction (y-axis) is vertical in this simulation
+                            double temp_diff = temperature[index] - ambient_temperature;
+                            v[index] += dt * gravity * thermal_expansion * temp_diff;
+                        }
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 void FluidSolver::applyObstacleDrag() {
@@ -136,255 +532,292 @@ void FluidSolver::applyObstacleDrag() {
     // This creates stronger velocity gradients and shear layers
     double drag_coefficient = 2.5;  // Enhanced drag factor
     
-    #pragma omp parallel for collapse(3)
-    for (int k = 1; k < nz - 1; ++k) {
-        for (int j = 1; j < ny - 1; ++j) {
-            for (int i = 1; i < nx - 1; ++i) {
-                int index = idx(i, j, k);
+    // Only fluid cells adjacent to obstacles are affected; their indices are
+    // precomputed in updateObstacleData() instead of scanning the whole grid
+    const std::vector<size_t>& drag_cells = obstacle_data->drag_cells;
+    size_t plane = static_cast<size_t>(nx) * ny;
+    
+    forEachSlab(1, nz - 1, 0, {&u, &v, &w}, [&](int k0, int k1) {
+        // The list is sorted, so this slab's cells are a contiguous range
+        auto first = std::lower_bound(drag_cells.begin(), drag_cells.end(), k0 * plane);
+        auto last = std::lower_bound(first, drag_cells.end(), k1 * plane);
+        size_t offset = first - drag_cells.begin();
+        int num_cells = static_cast<int>(last - first);
+        
+        #pragma omp parallel for
+        for (int n = 0; n < num_cells; ++n) {
+            size_t index = drag_cells[offset + n];
+            
+            // Apply drag force proportional to velocity
+            // This simulates enhanced friction at obstacle boundaries
+            double vel_mag = std::sqrt(u[index]*u[index] + 
+                                       v[index]*v[index] + 
+                                       w[index]*w[index]);
+            
+            if (vel_mag > 0.01) {
+                double drag_factor = 1.0 - drag_coefficient * dt * vel_mag;
+                drag_factor = std::max(0.3, drag_factor);  // Don't reduce below 30%
                 
-                // Only apply to fluid cells adjacent to obstacles
-                if (!obstacles[index]) {
-                    // Check if any neighbor is an obstacle
-                    bool near_obstacle = false;
-                    near_obstacle |= obstacles[idx(i-1, j, k)];
-                    near_obstacle |= obstacles[idx(i+1, j, k)];
-                    near_obstacle |= obstacles[idx(i, j-1, k)];
-                    near_obstacle |= obstacles[idx(i, j+1, k)];
-                    near_obstacle |= obstacles[idx(i, j, k-1)];
-                    near_obstacle |= obstacles[idx(i, j, k+1)];
-                    
-                    if (near_obstacle) {
-                        // Apply drag force proportional to velocity
-                        // This simulates enhanced friction at obstacle boundaries
-                        double vel_mag = std::sqrt(u[index]*u[index] + 
-                                                   v[index]*v[index] + 
-                                                   w[index]*w[index]);
-                        
-                        if (vel_mag > 0.01) {
-                            double drag_factor = 1.0 - drag_coefficient * dt * vel_mag;
-                            drag_factor = std::max(0.3, drag_factor);  // Don't reduce below 30%
-                            
-                            u[index] *= drag_factor;
-                            v[index] *= drag_factor;
-                            w[index] *= drag_factor;
-                        }
-                    }
-                }
+                u[index] *= drag_factor;
+                v[index] *= drag_factor;
+                w[index] *= drag_factor;
             }
         }
-    }
+    });
 }
 
-void FluidSolver::advect(std::vector<double>& field, const std::vector<double>& field_prev) {
+void FluidSolver::advect(Field& field, const Field& field_prev) {
+    const std::vector<bool>& obstacles = obstacle_data->mask;
     double dt0 = dt / dx;
     
-    #pragma omp parallel for collapse(3)
-    for (int k = 1; k < nz - 1; ++k) {
-        for (int j = 1; j < ny - 1; ++j) {
-            for (int i = 1; i < nx - 1; ++i) {
-                int index = idx(i, j, k);
-                
-                if (obstacles[index]) {
-                    field[index] = 0.0;
-                    continue;
+    forEachSlab(1, nz - 1, advect_reach, {&field, &field_prev, &u_prev, &v_prev, &w_prev},
+                [&](int kb, int ke) {
+        #pragma omp parallel for collapse(3)
+        for (int k = kb; k < ke; ++k) {
+            for (int j = 1; j < ny - 1; ++j) {
+                for (int i = 1; i < nx - 1; ++i) {
+                    size_t index = idx(i, j, k);
+                    
+                    if (obstacles[index]) {
+                        field[index] = 0.0;
+                        continue;
+                    }
+                    
+                    // Backtrace
+                    double x = i - dt0 * u_prev[index];
+                    double y = j - dt0 * v_prev[index];
+                    double z = k - dt0 * w_prev[index];
+                    
+                    // Clamp to grid
+                    x = std::max(0.5, std::min(x, nx - 1.5));
+                    y = std::max(0.5, std::min(y, ny - 1.5));
+                    z = std::max(0.5, std::min(z, nz - 1.5));
+                    
+                    // Trilinear interpolation
+                    int i0 = (int)x, i1 = i0 + 1;
+                    int j0 = (int)y, j1 = j0 + 1;
+                    int k0 = (int)z, k1 = k0 + 1;
+                    
+                    double sx1 = x - i0, sx0 = 1.0 - sx1;
+                    double sy1 = y - j0, sy0 = 1.0 - sy1;
+                    double sz1 = z - k0, sz0 = 1.0 - sz1;
+                    
+                    field[index] = 
+                        sz0 * (sy0 * (sx0 * field_prev[idx(i0, j0, k0)] + 
+                                      sx1 * field_prev[idx(i1, j0, k0)]) +
+                               sy1 * (sx0 * field_prev[idx(i0, j1, k0)] + 
+                                      sx1 * field_prev[idx(i1, j1, k0)])) +
+                        sz1 * (sy0 * (sx0 * field_prev[idx(i0, j0, k1)] + 
+                                      sx1 * field_prev[idx(i1, j0, k1)]) +
+                               sy1 * (sx0 * field_prev[idx(i0, j1, k1)] + 
+                                      sx1 * field_prev[idx(i1, j1, k1)]));
                 }
-                
-                // Backtrace
-                double x = i - dt0 * u_prev[index];
-                double y = j - dt0 * v_prev[index];
-                double z = k - dt0 * w_prev[index];
-                
-                // Clamp to grid
-                x = std::max(0.5, std::min(x, nx - 1.5));
-                y = std::max(0.5, std::min(y, ny - 1.5));
-                z = std::max(0.5, std::min(z, nz - 1.5));
-                
-                // Trilinear interpolation
-                int i0 = (int)x, i1 = i0 + 1;
-                int j0 = (int)y, j1 = j0 + 1;
-                int k0 = (int)z, k1 = k0 + 1;
-                
-                double sx1 = x - i0, sx0 = 1.0 - sx1;
-                double sy1 = y - j0, sy0 = 1.0 - sy1;
-                double sz1 = z - k0, sz0 = 1.0 - sz1;
-                
-                field[index] = 
-                    sz0 * (sy0 * (sx0 * field_prev[idx(i0, j0, k0)] + 
-                                  sx1 * field_prev[idx(i1, j0, k0)]) +
-                           sy1 * (sx0 * field_prev[idx(i0, j1, k0)] + 
-                                  sx1 * field_prev[idx(i1, j1, k0)])) +
-                    sz1 * (sy0 * (sx0 * field_prev[idx(i0, j0, k1)] + 
-                                  sx1 * field_prev[idx(i1, j0, k1)]) +
-                           sy1 * (sx0 * field_prev[idx(i0, j1, k1)] + 
-                                  sx1 * field_prev[idx(i1, j1, k1)]));
             }
         }
-    }
+    });
 }
 
-void FluidSolver::diffuse(std::vector<double>& field, const std::vector<double>& field_prev, 
-                         double diff_coef) {
+void FluidSolver::diffuse(Field& field, const Field& field_prev, double diff_coef) {
     // Physically correct diffusion: coefficient scaled by dt/(dx²)
     // For 3D heat equation: ∂T/∂t = α∇²T
     double a = dt * diff_coef / (dx * dx);
     jacobiIteration(field, field_prev, a, 1.0 + 6.0 * a, 20);
 }
 
-void FluidSolver::jacobiIteration(std::vector<double>& x, const std::vector<double>& b,
+void FluidSolver::jacobiIteration(Field& x, const Field& b,
                                  double alpha, double beta, int iterations) {
-    std::vector<double> x_new = x;
+    const std::vector<bool>& obstacles = obstacle_data->mask;
+    
+    // The scratch field must carry x's boundary layer, which is never written
+    Field& x_new = jacobi_scratch;
+    copyField(x_new, x);
     
     for (int iter = 0; iter < iterations; ++iter) {
-        #pragma omp parallel for collapse(3)
-        for (int k = 1; k < nz - 1; ++k) {
-            for (int j = 1; j < ny - 1; ++j) {
-                for (int i = 1; i < nx - 1; ++i) {
-                    int index = idx(i, j, k);
-                    
-                    if (obstacles[index]) {
-                        x_new[index] = 0.0;
-                        continue;
+        forEachSlab(1, nz - 1, 1, {&x, &x_new, &b}, [&](int k0, int k1) {
+            #pragma omp parallel for collapse(3)
+            for (int k = k0; k < k1; ++k) {
+                for (int j = 1; j < ny - 1; ++j) {
+                    for (int i = 1; i < nx - 1; ++i) {
+                        size_t index = idx(i, j, k);
+                        
+                        if (obstacles[index]) {
+                            x_new[index] = 0.0;
+                            continue;
+                        }
+                        
+                        double sum = x[idx(i-1, j, k)] + x[idx(i+1, j, k)] +
+                                    x[idx(i, j-1, k)] + x[idx(i, j+1, k)] +
+                                    x[idx(i, j, k-1)] + x[idx(i, j, k+1)];
+                        
+                        x_new[index] = (b[index] + alpha * sum) / beta;
                     }
-                    
-                    double sum = x[idx(i-1, j, k)] + x[idx(i+1, j, k)] +
-                                x[idx(i, j-1, k)] + x[idx(i, j+1, k)] +
-                                x[idx(i, j, k-1)] + x[idx(i, j, k+1)];
-                    
-                    x_new[index] = (b[index] + alpha * sum) / beta;
                 }
             }
-        }
+        });
         x.swap(x_new);
     }
 }
 
 void FluidSolver::project() {
-    std::vector<double> div(nx * ny * nz, 0.0);
+    const std::vector<bool>& obstacles = obstacle_data->mask;
     
-    // Compute divergence
-    #pragma omp parallel for collapse(3)
-    for (int k = 1; k < nz - 1; ++k) {
-        for (int j = 1; j < ny - 1; ++j) {
-            for (int i = 1; i < nx - 1; ++i) {
-                int index = idx(i, j, k);
-                
-                if (obstacles[index]) continue;
-                
-                div[index] = -0.5 * dx * (
-                    u[idx(i+1, j, k)] - u[idx(i-1, j, k)] +
-                    v[idx(i, j+1, k)] - v[idx(i, j-1, k)] +
-                    w[idx(i, j, k+1)] - w[idx(i, j, k-1)]
-                );
+    // Compute divergence. Only the interior is reset: the outer layer is
+    // Dirichlet data - zero for the wind tunnel, interpolated base-grid
+    // pressure for AMR patches
+    forEachSlab(1, nz - 1, 1, {&u, &v, &w, &div, &pressure}, [&](int k0, int k1) {
+        #pragma omp parallel for collapse(3)
+        for (int k = k0; k < k1; ++k) {
+            for (int j = 1; j < ny - 1; ++j) {
+                for (int i = 1; i < nx - 1; ++i) {
+                    size_t index = idx(i, j, k);
+                    pressure[index] = 0.0;
+                    
+                    if (obstacles[index]) {
+                        div[index] = 0.0;
+                        continue;
+                    }
+                    
+                    div[index] = -0.5 * dx * (
+                        u[idx(i+1, j, k)] - u[idx(i-1, j, k)] +
+                        v[idx(i, j+1, k)] - v[idx(i, j-1, k)] +
+                        w[idx(i, j, k+1)] - w[idx(i, j, k-1)]
+                    );
+                }
             }
         }
-    }
+    });
     
     // Solve for pressure
-    std::fill(pressure.begin(), pressure.end(), 0.0);
     jacobiIteration(pressure, div, 1.0, 6.0, 40);
     
     // Subtract pressure gradient
-    #pragma omp parallel for collapse(3)
-    for (int k = 1; k < nz - 1; ++k) {
-        for (int j = 1; j < ny - 1; ++j) {
-            for (int i = 1; i < nx - 1; ++i) {
-                int index = idx(i, j, k);
-                
-                if (obstacles[index]) {
-                    u[index] = 0.0;
-                    v[index] = 0.0;
-                    w[index] = 0.0;
-                    continue;
+    forEachSlab(1, nz - 1, 1, {&u, &v, &w, &pressure}, [&](int k0, int k1) {
+        #pragma omp parallel for collapse(3)
+        for (int k = k0; k < k1; ++k) {
+            for (int j = 1; j < ny - 1; ++j) {
+                for (int i = 1; i < nx - 1; ++i) {
+                    size_t index = idx(i, j, k);
+                    
+                    if (obstacles[index]) {
+                        u[index] = 0.0;
+                        v[index] = 0.0;
+                        w[index] = 0.0;
+                        continue;
+                    }
+                    
+                    u[index] -= 0.5 * (pressure[idx(i+1, j, k)] - pressure[idx(i-1, j, k)]) / dx;
+                    v[index] -= 0.5 * (pressure[idx(i, j+1, k)] - pressure[idx(i, j-1, k)]) / dx;
+                    w[index] -= 0.5 * (pressure[idx(i, j, k+1)] - pressure[idx(i, j, k-1)]) / dx;
                 }
-                
-                u[index] -= 0.5 * (pressure[idx(i+1, j, k)] - pressure[idx(i-1, j, k)]) / dx;
-                v[index] -= 0.5 * (pressure[idx(i, j+1, k)] - pressure[idx(i, j-1, k)]) / dx;
-                w[index] -= 0.5 * (pressure[idx(i, j, k+1)] - pressure[idx(i, j, k-1)]) / dx;
             }
         }
-    }
+    });
 }
 
 void FluidSolver::applyBoundaryConditions() {
     // Apply boundary conditions for velocity and obstacles
-    #pragma omp parallel for collapse(3)
-    for (int k = 0; k < nz; ++k) {
-        for (int j = 0; j < ny; ++j) {
+    const std::vector<bool>& obstacles = obstacle_data->mask;
+    bool external = boundary_mode == BoundaryMode::External;
+    
+    // Everything except the z faces only touches cells of its own plane
+    forEachSlab(0, nz, 0, {&u, &v, &w, &density, &temperature}, [&](int k0, int k1) {
+        #pragma omp parallel for collapse(3)
+        for (int k = k0; k < k1; ++k) {
+            for (int j = 0; j < ny; ++j) {
+                for (int i = 0; i < nx; ++i) {
+                    size_t index = idx(i, j, k);
+                    
+                    // Zero velocity at obstacles
+                    if (obstacles[index]) {
+                        u[index] = 0.0;
+                        v[index] = 0.0;
+                        w[index] = 0.0;
+                        density[index] = 0.0;  // No smoke inside obstacles
+                        temperature[index] = 0.0;
+                    }
+                }
+            }
+        }
+        
+        // Ghost layer values are supplied by the owner of an external-mode solver
+        if (external) {
+            return;
+        }
+        
+        // Apply reflective boundary conditions (Neumann - zero gradient)
+        // This keeps smoke contained within the volume
+        
+        // X boundaries - Wind Tunnel: Inlet (left) and Outlet (right)
+        #pragma omp parallel for collapse(2)
+        for (int k = k0; k < k1; ++k) {
+            for (int j = 0; j < ny; ++j) {
+                // INLET at left boundary (i=0) - constant velocity inflow
+                u[idx(0, j, k)] = inlet_velocity_u;
+                v[idx(0, j, k)] = inlet_velocity_v;
+                w[idx(0, j, k)] = inlet_velocity_w;
+                density[idx(0, j, k)] = 0.0;  // No smoke at inlet initially
+                temperature[idx(0, j, k)] = ambient_temperature;
+                
+                // OUTLET at right boundary (i=nx-1) - zero gradient outflow
+                u[idx(nx-1, j, k)] = u[idx(nx-2, j, k)];
+                v[idx(nx-1, j, k)] = v[idx(nx-2, j, k)];
+                w[idx(nx-1, j, k)] = w[idx(nx-2, j, k)];
+                density[idx(nx-1, j, k)] = density[idx(nx-2, j, k)];  // Smoke flows out
+                temperature[idx(nx-1, j, k)] = temperature[idx(nx-2, j, k)];
+            }
+        }
+        
+        // Y boundaries
+        #pragma omp parallel for collapse(2)
+        for (int k = k0; k < k1; ++k) {
             for (int i = 0; i < nx; ++i) {
-                int index = idx(i, j, k);
+                // Bottom boundary (j=0)
+                u[idx(i, 0, k)] = u[idx(i, 1, k)];
+                v[idx(i, 0, k)] = 0.0;
+                w[idx(i, 0, k)] = w[idx(i, 1, k)];
+                density[idx(i, 0, k)] = density[idx(i, 1, k)];
+                temperature[idx(i, 0, k)] = temperature[idx(i, 1, k)];
                 
-                // Zero velocity at obstacles
-                if (obstacles[index]) {
-                    u[index] = 0.0;
-                    v[index] = 0.0;
-                    w[index] = 0.0;
-                    density[index] = 0.0;  // No smoke inside obstacles
-                    temperature[index] = 0.0;
-                }
+                // Top boundary (j=ny-1)
+                u[idx(i, ny-1, k)] = u[idx(i, ny-2, k)];
+                v[idx(i, ny-1, k)] = 0.0;
+                w[idx(i, ny-1, k)] = w[idx(i, ny-2, k)];
+                density[idx(i, ny-1, k)] = density[idx(i, ny-2, k)];
+                temperature[idx(i, ny-1, k)] = temperature[idx(i, ny-2, k)];
             }
         }
-    }
-    
-    // Apply reflective boundary conditions (Neumann - zero gradient)
-    // This keeps smoke contained within the volume
+    });
     
-    // X boundaries - Wind Tunnel: Inlet (left) and Outlet (right)
-    #pragma omp parallel for collapse(2)
-    for (int k = 0; k < nz; ++k) {
-        for (int j = 0; j < ny; ++j) {
-            // INLET at left boundary (i=0) - constant velocity inflow
-            u[idx(0, j, k)] = inlet_velocity_u;
-            v[idx(0, j, k)] = inlet_velocity_v;
-            w[idx(0, j, k)] = inlet_velocity_w;
-            density[idx(0, j, k)] = 0.0;  // No smoke at inlet initially
-            temperature[idx(0, j, k)] = ambient_temperature;
-            
-            // OUTLET at right boundary (i=nx-1) - zero gradient outflow
-            u[idx(nx-1, j, k)] = u[idx(nx-2, j, k)];
-            v[idx(nx-1, j, k)] = v[idx(nx-2, j, k)];
-            w[idx(nx-1, j, k)] = w[idx(nx-2, j, k)];
-            density[idx(nx-1, j, k)] = density[idx(nx-2, j, k)];  // Smoke flows out
-            temperature[idx(nx-1, j, k)] = temperature[idx(nx-2, j, k)];
-        }
+    if (external) {
+        return;
     }
     
-    // Y boundaries
-    #pragma omp parallel for collapse(2)
-    for (int k = 0; k < nz; ++k) {
-        for (int i = 0; i < nx; ++i) {
-            // Bottom boundary (j=0)
-            u[idx(i, 0, k)] = u[idx(i, 1, k)];
-            v[idx(i, 0, k)] = 0.0;
-            w[idx(i, 0, k)] = w[idx(i, 1, k)];
-            density[idx(i, 0, k)] = density[idx(i, 1, k)];
-            temperature[idx(i, 0, k)] = temperature[idx(i, 1, k)];
-            
-            // Top boundary (j=ny-1)
-            u[idx(i, ny-1, k)] = u[idx(i, ny-2, k)];
-            v[idx(i, ny-1, k)] = 0.0;
-            w[idx(i, ny-1, k)] = w[idx(i, ny-2, k)];
-            density[idx(i, ny-1, k)] = density[idx(i, ny-2, k)];
-            temperature[idx(i, ny-1, k)] = temperature[idx(i, ny-2, k)];
+    // Z boundaries. Each face is its own slab sweep so only the two planes
+    // next to it are paged in.
+    forEachSlab(0, 1, 1, {&u, &v, &w, &density, &temperature}, [&](int, int) {
+        #pragma omp parallel for collapse(2)
+        for (int j = 0; j < ny; ++j) {
+            for (int i = 0; i < nx; ++i) {
+                // Front boundary (k=0)
+                u[idx(i, j, 0)] = u[idx(i, j, 1)];
+                v[idx(i, j, 0)] = v[idx(i, j, 1)];
+                w[idx(i, j, 0)] = 0.0;
+                density[idx(i, j, 0)] = density[idx(i, j, 1)];
+                temperature[idx(i, j, 0)] = temperature[idx(i, j, 1)];
+            }
         }
-    }
-    
-    // Z boundaries
-    #pragma omp parallel for collapse(2)
-    for (int j = 0; j < ny; ++j) {
-        for (int i = 0; i < nx; ++i) {
-            // Front boundary (k=0)
-            u[idx(i, j, 0)] = u[idx(i, j, 1)];
-            v[idx(i, j, 0)] = v[idx(i, j, 1)];
-            w[idx(i, j, 0)] = 0.0;
-            density[idx(i, j, 0)] = density[idx(i, j, 1)];
-            temperature[idx(i, j, 0)] = temperature[idx(i, j, 1)];
-            
-            // Back boundary (k=nz-1)
-            u[idx(i, j, nz-1)] = u[idx(i, j, nz-2)];
-            v[idx(i, j, nz-1)] = v[idx(i, j, nz-2)];
-            w[idx(i, j, nz-1)] = 0.0;
-            density[idx(i, j, nz-1)] = density[idx(i, j, nz-2)];
-            temperature[idx(i, j, nz-1)] = temperature[idx(i, j, nz-2)];
+    });
+    forEachSlab(nz - 1, nz, 1, {&u, &v, &w, &density, &temperature}, [&](int, int) {
+        #pragma omp parallel for collapse(2)
+        for (int j = 0; j < ny; ++j) {
+            for (int i = 0; i < nx; ++i) {
+                // Back boundary (k=nz-1)
+                u[idx(i, j, nz-1)] = u[idx(i, j, nz-2)];
+                v[idx(i, j, nz-1)] = v[idx(i, j, nz-2)];
+                w[idx(i, j, nz-1)] = 0.0;
+                density[idx(i, j, nz-1)] = density[idx(i, j, nz-2)];
+                temperature[idx(i, j, nz-1)] = temperature[idx(i, j, nz-2)];
+            }
         }
-    }
+    });
 }
@@ -1,42 +1,170 @@
 #pragma once
 
+#include "Field.h"
 #include <vector>
+#include <memory>
+#include <cstdint>
 #include <cmath>
 #include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <limits>
 
 class FluidSolver {
 public:
+    // WindTunnel: inlet/outlet and wall conditions on the domain faces.
+    // External: the outermost layer of cells is a ghost layer filled by the
+    // caller before each step (used for AMR patches).
+    enum class BoundaryMode { WindTunnel, External };
+    
     FluidSolver(int nx, int ny, int nz, double dx, double dt);
     
     // Main simulation step
     void step();
     
+    // Project velocity to be divergence-free. Part of step(); also used on
+    // its own to re-synchronise the base grid after AMR restriction.
+    void project();
+    
+    void setBoundaryMode(BoundaryMode mode) { boundary_mode = mode; }
+    
+    // Out-of-core execution: when the solver is created after
+    // Field::setSpillDirectory(), its fields live in files and kernels sweep
+    // them in z-slabs, keeping about window_bytes resident at a time.
+    bool isOutOfCore() const { return out_of_core; }
+    void setMemoryWindow(size_t bytes) { window_bytes = bytes; }
+    
+    // Drop all field pages from memory (out-of-core only), e.g. after
+    // writing output
+    void releaseMemory();
+    
+    // Convergence metrics, computed at the end of every step() once enabled.
+    // Changes compare the velocity with the one at the end of the previous
+    // step; enabling keeps a copy of it (three extra fields).
+    struct StepMetrics {
+        double velocity_change_l2 = 0.0;   // ||u - u_last||_2 / ||u||_2
+        double velocity_change_max = 0.0;  // max |u - u_last| / max |u|
+        double divergence_l2 = 0.0;        // RMS of div u over interior fluid cells (1/s)
+        double divergence_max = 0.0;       // max |div u| over interior fluid cells (1/s)
+    };
+    void enableMetrics(bool enable);
+    bool metricsEnabled() const { return !u_last.empty(); }
+    const StepMetrics& getMetrics() const { return metrics; }
+    
+    // With deferred metrics, step() leaves computing them to the owner,
+    // which calls updateMetrics() once the step's state is final (AMR does
+    // so after restriction and re-projection).
+    void setMetricsDeferred(bool deferred) { metrics_deferred = deferred; }
+    void updateMetrics();
+    
     // Add smoke source
     void addSource(int x, int y, int z, double density, double temperature);
     
+    // Emitters: smoke sources registered once and applied inside step().
+    // Rates are per unit time; an emitter is active while
+    // start_time <= t < end_time. Cells outside the grid are ignored.
+    // Positions and the sphere radius are in grid cells, not world units
+    // as in Geometry (divide by dx). Each returns an emitter id;
+    // addMaskEmitter returns -1 and adds nothing if the mask is not
+    // nx*ny*nz entries.
+    int addBoxEmitter(int x0, int y0, int z0, int x1, int y1, int z1,  // [x0, x1) etc.
+                      double density_rate, double temperature_rate,
+                      double start_time = 0.0,
+                      double end_time = std::numeric_limits<double>::infinity());
+    int addSphereEmitter(double cx, double cy, double cz, double radius,
+                         double density_rate, double temperature_rate,
+                         double start_time = 0.0,
+                         double end_time = std::numeric_limits<double>::infinity());
+    int addMaskEmitter(const std::vector<uint8_t>& mask,  // nx*ny*nz, 1 = emit
+                       double density_rate, double temperature_rate,
+                       double start_time = 0.0,
+                       double end_time = std::numeric_limits<double>::infinity());
+    void setEmitterSchedule(int id, double start_time, double end_time);
+    void clearEmitters() { emitters.clear(); }
+    
+    // Registered emitters, stored as runs of consecutive cell indices so
+    // injection is a flat loop regardless of the emitter's shape. Runs are
+    // sorted and never cross a z-plane, so a slab's runs are a subrange.
+    struct Emitter {
+        std::vector<std::pair<size_t, int>> spans;  // (first index, length)
+        double density_rate;
+        double temperature_rate;
+        double start_time;
+        double end_time;
+    };
+    const std::vector<Emitter>& getEmitters() const { return emitters; }
+    
     // Set obstacle
     void setObstacle(int x, int y, int z, bool is_obstacle);
     
+    // Replace the whole obstacle mask at once (nx*ny*nz entries, 1 = obstacle).
+    // Returns false, leaving the obstacles unchanged, if the size is wrong.
+    bool setObstacleMask(const std::vector<uint8_t>& mask);
+    
+    // Obstacle geometry: the mask and the cell lists derived from it.
+    // Read-only during step(), so it can be shared between solvers on the
+    // same grid (see shareObstacles).
+    struct ObstacleData {
+        int nx = 0, ny = 0, nz = 0;
+        std::vector<bool> mask;
+        std::vector<size_t> drag_cells;  // Interior fluid cells with an obstacle face-neighbour
+        bool dirty = true;               // drag_cells needs rebuilding
+    };
+    
+    // Complete obstacle data for an nx*ny*nz grid from a mask (1 = obstacle),
+    // without a solver; nullptr if the mask size is wrong
+    static std::shared_ptr<ObstacleData> buildObstacles(int nx, int ny, int nz,
+                                                        const std::vector<uint8_t>& mask);
+    
+    // Use obstacle data from buildObstacles() instead of a private copy, so
+    // that many solvers (an ensemble) hold the geometry once. Only the
+    // pointer is copied; the data is never written while shared, and a later
+    // setObstacle() detaches this solver onto its own copy first. Returns
+    // false, sharing nothing, for another grid or incomplete data.
+    bool shareObstacles(const std::shared_ptr<ObstacleData>& data);
+    
     // Set inlet velocity (for wind tunnel)
     void setInletVelocity(double inlet_u, double inlet_v, double inlet_w);
     
+    // Physical parameters
+    void setViscosity(double nu) { viscosity = nu; }
+    void setThermalDiffusivity(double alpha) { thermal_diffusivity = alpha; }
+    void setMassDiffusivity(double d) { mass_diffusivity = d; }
+    double getViscosity() const { return viscosity; }
+    double getThermalDiffusivity() const { return thermal_diffusivity; }
+    double getMassDiffusivity() const { return mass_diffusivity; }
+    
     // Getters for visualization
-    const std::vector<double>& getDensity() const { return density; }
-    const std::vector<double>& getTemperature() const { return temperature; }
-    const std::vector<bool>& getObstacles() const { return obstacles; }
-    const std::vector<double>& getVelocityU() const { return u; }
-    const std::vector<double>& getVelocityV() const { return v; }
-    const std::vector<double>& getVelocityW() const { return w; }
+    const Field& getDensity() const { return density; }
+    const Field& getTemperature() const { return temperature; }
+    const std::vector<bool>& getObstacles() const { return obstacle_data->mask; }
+    const Field& getVelocityU() const { return u; }
+    const Field& getVelocityV() const { return v; }
+    const Field& getVelocityW() const { return w; }
+    const Field& getPressure() const { return pressure; }
+    
+    // Mutable field access for coupling solvers (AMR ghost fill/restriction)
+    Field& getDensity() { return density; }
+    Field& getTemperature() { return temperature; }
+    Field& getVelocityU() { return u; }
+    Field& getVelocityV() { return v; }
+    Field& getVelocityW() { return w; }
+    Field& getPressure() { return pressure; }
     
     int getNx() const { return nx; }
     int getNy() const { return ny; }
     int getNz() const { return nz; }
     double getDx() const { return dx; }
+    double getDt() const { return dt; }
+    double getTime() const { return step_count * dt; }
+    long long getStepCount() const { return step_count; }
     
 private:
     // Grid dimensions
     int nx, ny, nz;
     double dx, dt;
+    long long step_count;       // Completed steps; time = step_count * dt
+    BoundaryMode boundary_mode;
     
     // Physical parameters (dimensionless)
     double viscosity;           // Kinematic viscosity (momentum diffusivity)
@@ -52,26 +180,56 @@ private:
     double inlet_velocity_w;
     
     // Grid data
-    std::vector<double> u, v, w;           // velocity components
-    std::vector<double> u_prev, v_prev, w_prev;
-    std::vector<double> density, density_prev;
-    std::vector<double> temperature, temperature_prev;
-    std::vector<double> pressure;
-    std::vector<bool> obstacles;
+    Field u, v, w;           // velocity components
+    Field u_prev, v_prev, w_prev;
+    Field density, density_prev;
+    Field temperature, temperature_prev;
+    Field pressure;
+    
+    // Scratch fields, kept between steps instead of reallocated per call
+    Field jacobi_scratch;
+    Field div;
+    
+    // Velocity at the end of the previous step; empty unless metrics are on
+    Field u_last, v_last, w_last;
+    StepMetrics metrics;
+    bool metrics_deferred;
+    
+    // Out-of-core state
+    bool out_of_core;
+    size_t window_bytes;     // Resident budget for one slab sweep
+    int advect_reach;        // Planes a backtrace can reach (+1 for interpolation)
+    
+    std::shared_ptr<ObstacleData> obstacle_data;
+    
+    std::vector<Emitter> emitters;
     
     // Helper functions
-    int idx(int i, int j, int k) const;
+    size_t idx(int i, int j, int k) const;
     bool isValid(int i, int j, int k) const;
+    void updateObstacleData();
+    static void buildDragCells(ObstacleData& data);
+    int addEmitter(Emitter emitter, double density_rate, double temperature_rate,
+                   double start_time, double end_time);
+    
+    // Run body(k0, k1) over z-slabs covering [k_begin, k_end). In-core this
+    // is a single call. Out-of-core, slabs are sized to the memory window,
+    // the next slab of each field is prefetched before the current one is
+    // processed, and planes more than halo behind it are released.
+    void forEachSlab(int k_begin, int k_end, int halo,
+                     std::initializer_list<const Field*> fields,
+                     const std::function<void(int, int)>& body);
+    void copyField(Field& dst, const Field& src);
+    void updateAdvectionReach();
     
     // Simulation steps
-    void advect(std::vector<double>& field, const std::vector<double>& field_prev);
-    void diffuse(std::vector<double>& field, const std::vector<double>& field_prev, double diff_coef);
-    void project();
-    void applyBuoyancy();
+    void advect(Field& field, const Field& field_prev);
+    void diffuse(Field& field, const Field& field_prev, double diff_coef);
+    void applySourcesAndBuoyancy();
     void applyObstacleDrag();
     void applyBoundaryConditions();
     
     // Linear solver
-    void jacobiIteration(std::vector<double>& x, const std::vector<double>& b, 
+    void jacobiIteration(Field& x, const Field& b,
                         double alpha, double beta, int iterations);
 };
@@ -0,0 +1,453 @@
+#include "Geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+// Index range of grid points whose coordinate lies in [lo, hi]
+void cellRange(double lo, double hi, double origin, double dx, int n, int& first, int& last) {
+    first = static_cast<int>(std::max(0.0, std::ceil((lo - origin) / dx)));
+    last = static_cast<int>(std::min(n - 1.0, std::floor((hi - origin) / dx)));
+}
+
+// FNV-1a, 64 bit
+void hashBytes(uint64_t& h, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t n = 0; n < size; ++n) {
+        h ^= bytes[n];
+        h *= 1099511628211ULL;
+    }
+}
+
+template <typename T>
+void hashValue(uint64_t& h, const T& value) {
+    hashBytes(h, &value, sizeof(value));
+}
+
+const char kCacheMagic[8] = {'F', 'S', 'V', 'O', 'X', 'E', 'L', '1'};
+
+} // namespace
+
+void Geometry::addSphere(double cx, double cy, double cz, double radius) {
+    Shape shape;
+    shape.type = Shape::Sphere;
+    shape.axis = 0;
+    double params[6] = {cx, cy, cz, radius, 0.0, 0.0};
+    std::copy(params, params + 6, shape.params);
+    double bounds[6] = {cx - radius, cy - radius, cz - radius,
+                        cx + radius, cy + radius, cz + radius};
+    std::copy(bounds, bounds + 6, shape.bounds);
+    shapes.push_back(shape);
+}
+
+void Geometry::addCylinder(int axis, double a, double b, double radius, double lo, double hi) {
+    Shape shape;
+    shape.type = Shape::Cylinder;
+    shape.axis = axis;
+    double params[6] = {a, b, radius, lo, hi, 0.0};
+    std::copy(params, params + 6, shape.params);
+
+    // (a, b) are the two coordinates perpendicular to the axis, in order
+    int ca = (axis == 0) ? 1 : 0;
+    int cb = (axis == 2) ? 1 : 2;
+    shape.bounds[axis] = lo;
+    shape.bounds[axis + 3] = hi;
+    shape.bounds[ca] = a - radius;
+    shape.bounds[ca + 3] = a + radius;
+    shape.bounds[cb] = b - radius;
+    shape.bounds[cb + 3] = b + radius;
+    shapes.push_back(shape);
+}
+
+void Geometry::addBox(double x0, double y0, double z0, double x1, double y1, double z1) {
+    Shape shape;
+    shape.type = Shape::Box;
+    shape.axis = 0;
+    double params[6] = {std::min(x0, x1), std::min(y0, y1), std::min(z0, z1),
+                        std::max(x0, x1), std::max(y0, y1), std::max(z0, z1)};
+    std::copy(params, params + 6, shape.params);
+    std::copy(params, params + 6, shape.bounds);
+    shapes.push_back(shape);
+}
+
+bool Geometry::addSTL(const std::string& filename, double scale, double tx, double ty, double tz) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Cannot open STL file " << filename << std::endl;
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Mesh mesh;
+
+    // Binary STL: 80 byte header, triangle count, 50 bytes per triangle.
+    // ASCII files starting with "solid" can never match this size exactly.
+    uint32_t count = 0;
+    if (data.size() >= 84) {
+        std::memcpy(&count, data.data() + 80, sizeof(count));
+    }
+    if (data.size() >= 84 && data.size() == 84 + 50 * static_cast<size_t>(count)) {
+        mesh.triangles.resize(count);
+        for (uint32_t t = 0; t < count; ++t) {
+            const char* record = data.data() + 84 + 50 * static_cast<size_t>(t);
+            float values[12];  // normal, then three vertices
+            std::memcpy(values, record, sizeof(values));
+            for (int v = 0; v < 3; ++v) {
+                for (int c = 0; c < 3; ++c) {
+                    mesh.triangles[t].v[v][c] = values[3 + 3 * v + c];
+                }
+            }
+        }
+    } else {
+        std::istringstream text(std::string(data.begin(), data.end()));
+        std::string token;
+        Triangle triangle;
+        int vertex = 0;
+        while (text >> token) {
+            if (token != "vertex") continue;
+            text >> triangle.v[vertex][0] >> triangle.v[vertex][1] >> triangle.v[vertex][2];
+            if (++vertex == 3) {
+                mesh.triangles.push_back(triangle);
+                vertex = 0;
+            }
+        }
+    }
+
+    if (mesh.triangles.empty()) {
+        std::cerr << "Error: No triangles found in STL file " << filename << std::endl;
+        return false;
+    }
+
+    // Place the mesh in the domain and compute its bounding box
+    const double offset[3] = {tx, ty, tz};
+    for (int c = 0; c < 3; ++c) {
+        mesh.bounds[c] = std::numeric_limits<double>::max();
+        mesh.bounds[c + 3] = std::numeric_limits<double>::lowest();
+    }
+    for (Triangle& triangle : mesh.triangles) {
+        for (int v = 0; v < 3; ++v) {
+            for (int c = 0; c < 3; ++c) {
+                double& p = triangle.v[v][c];
+                p = p * scale + offset[c];
+                mesh.bounds[c] = std::min(mesh.bounds[c], p);
+                mesh.bounds[c + 3] = std::max(mesh.bounds[c + 3], p);
+            }
+        }
+    }
+
+    meshes.push_back(std::move(mesh));
+    return true;
+}
+
+bool Geometry::loadScene(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Cannot open scene file " << filename << std::endl;
+        return false;
+    }
+    std::filesystem::path scene_dir = std::filesystem::path(filename).parent_path();
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+
+        std::istringstream tokens(line);
+        std::string type;
+        if (!(tokens >> type)) {
+            continue;  // Blank line
+        }
+
+        bool ok = false;
+        if (type == "sphere") {
+            double cx, cy, cz, r;
+            if ((ok = static_cast<bool>(tokens >> cx >> cy >> cz >> r))) {
+                addSphere(cx, cy, cz, r);
+            }
+        }
+        else if (type == "cylinder") {
+            std::string axis_name;
+            double a, b, r;
+            double lo = -std::numeric_limits<double>::infinity();
+            double hi = std::numeric_limits<double>::infinity();
+            ok = static_cast<bool>(tokens >> axis_name >> a >> b >> r);
+            if (ok && !(tokens >> lo >> hi)) {
+                lo = -std::numeric_limits<double>::infinity();
+                hi = std::numeric_limits<double>::infinity();
+            }
+            int axis = (axis_name == "x") ? 0 : (axis_name == "y") ? 1 : (axis_name == "z") ? 2 : -1;
+            ok = ok && axis >= 0;
+            if (ok) {
+                addCylinder(axis, a, b, r, lo, hi);
+            }
+        }
+        else if (type == "box") {
+            double x0, y0, z0, x1, y1, z1;
+            if ((ok = static_cast<bool>(tokens >> x0 >> y0 >> z0 >> x1 >> y1 >> z1))) {
+                addBox(x0, y0, z0, x1, y1, z1);
+            }
+        }
+        else if (type == "stl") {
+            std::string path;
+            double scale = 1.0, tx = 0.0, ty = 0.0, tz = 0.0;
+            if (tokens >> path) {
+                // Optional fields keep their defaults when absent
+                double value[4];
+                if (tokens >> value[0]) {
+                    scale = value[0];
+                    if (tokens >> value[1] >> value[2] >> value[3]) {
+                        tx = value[1];
+                        ty = value[2];
+                        tz = value[3];
+                    }
+                }
+                std::filesystem::path stl_path(path);
+                if (stl_path.is_relative()) {
+                    stl_path = scene_dir / stl_path;
+                }
+                if (!addSTL(stl_path.string(), scale, tx, ty, tz)) {
+                    return false;
+                }
+                ok = true;
+            }
+        }
+        else {
+            std::cerr << filename << ":" << line_number
+                      << ": unknown shape '" << type << "'" << std::endl;
+            return false;
+        }
+
+        if (!ok) {
+            std::cerr << filename << ":" << line_number
+                      << ": invalid parameters for " << type << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Geometry::inside(const Shape& shape, double x, double y, double z) {
+    const double* p = shape.params;
+    switch (shape.type) {
+    case Shape::Sphere: {
+        double dx = x - p[0], dy = y - p[1], dz = z - p[2];
+        return dx*dx + dy*dy + dz*dz < p[3]*p[3];
+    }
+    case Shape::Cylinder: {
+        double pos[3] = {x, y, z};
+        int ca = (shape.axis == 0) ? 1 : 0;
+        int cb = (shape.axis == 2) ? 1 : 2;
+        double da = pos[ca] - p[0], db = pos[cb] - p[1];
+        double along = pos[shape.axis];
+        return da*da + db*db < p[2]*p[2] && along >= p[3] && along <= p[4];
+    }
+    case Shape::Box:
+        return x >= p[0] && x <= p[3] && y >= p[1] && y <= p[4] && z >= p[2] && z <= p[5];
+    }
+    return false;
+}
+
+void Geometry::voxelizeShape(const Shape& shape, std::vector<uint8_t>& mask,
+                             int nx, int ny, int nz, double dx,
+                             double ox, double oy, double oz) const {
+    // Only visit grid points inside the shape's bounding box
+    int i0, i1, j0, j1, k0, k1;
+    cellRange(shape.bounds[0], shape.bounds[3], ox, dx, nx, i0, i1);
+    cellRange(shape.bounds[1], shape.bounds[4], oy, dx, ny, j0, j1);
+    cellRange(shape.bounds[2], shape.bounds[5], oz, dx, nz, k0, k1);
+
+    #pragma omp parallel for collapse(2)
+    for (int k = k0; k <= k1; ++k) {
+        for (int j = j0; j <= j1; ++j) {
+            double z = oz + k * dx;
+            double y = oy + j * dx;
+            for (int i = i0; i <= i1; ++i) {
+                if (inside(shape, ox + i * dx, y, z)) {
+                    mask[i + static_cast<size_t>(nx) * (j + static_cast<size_t>(ny) * k)] = 1;
+                }
+            }
+        }
+    }
+}
+
+void Geometry::voxelizeMesh(const Mesh& mesh, std::vector<uint8_t>& mask,
+                            int nx, int ny, int nz, double dx,
+                            double ox, double oy, double oz) const {
+    int j0, j1, k0, k1;
+    cellRange(mesh.bounds[1], mesh.bounds[4], oy, dx, ny, j0, j1);
+    cellRange(mesh.bounds[2], mesh.bounds[5], oz, dx, nz, k0, k1);
+    if (j0 > j1 || k0 > k1) {
+        return;
+    }
+
+    // Bin triangles by the z rows they span (one row of slack either side
+    // for the ray offset below)
+    std::vector<std::vector<int>> rows(k1 - k0 + 1);
+    for (size_t t = 0; t < mesh.triangles.size(); ++t) {
+        const Triangle& tri = mesh.triangles[t];
+        double zmin = std::min({tri.v[0][2], tri.v[1][2], tri.v[2][2]});
+        double zmax = std::max({tri.v[0][2], tri.v[1][2], tri.v[2][2]});
+        int first, last;
+        cellRange(zmin, zmax, oz, dx, nz, first, last);
+        first = std::max(k0, first - 1);
+        last = std::min(k1, last + 1);
+        for (int k = first; k <= last; ++k) {
+            rows[k - k0].push_back(static_cast<int>(t));
+        }
+    }
+
+    // Rays are nudged off the grid lines so they never pass exactly
+    // through a shared edge or vertex and get counted twice
+    const double eps_y = 0.6180339887e-6 * dx;
+    const double eps_z = 0.4142135624e-6 * dx;
+
+    // Scanline parity fill: cast a ray along x through every (j, k) row and
+    // mark the points between each pair of surface crossings
+    #pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int k = k0; k <= k1; ++k) {
+        for (int j = j0; j <= j1; ++j) {
+            double y = oy + j * dx + eps_y;
+            double z = oz + k * dx + eps_z;
+            std::vector<double> crossings;
+
+            for (int t : rows[k - k0]) {
+                const double (*v)[3] = mesh.triangles[t].v;
+
+                // Barycentric coordinates of (y, z) in the triangle's yz projection
+                double det = (v[1][1] - v[0][1]) * (v[2][2] - v[0][2]) -
+                             (v[2][1] - v[0][1]) * (v[1][2] - v[0][2]);
+                if (std::abs(det) < 1e-14) continue;  // Parallel to the ray
+
+                double l1 = ((y - v[0][1]) * (v[2][2] - v[0][2]) -
+                             (v[2][1] - v[0][1]) * (z - v[0][2])) / det;
+                double l2 = ((v[1][1] - v[0][1]) * (z - v[0][2]) -
+                             (y - v[0][1]) * (v[1][2] - v[0][2])) / det;
+                double l0 = 1.0 - l1 - l2;
+                if (l0 < 0.0 || l1 < 0.0 || l2 < 0.0) continue;
+
+                crossings.push_back(l0 * v[0][0] + l1 * v[1][0] + l2 * v[2][0]);
+            }
+
+            std::sort(crossings.begin(), crossings.end());
+            for (size_t c = 0; c + 1 < crossings.size(); c += 2) {
+                int first = static_cast<int>(std::max(0.0, std::floor((crossings[c] - ox) / dx) + 1));
+                int last = static_cast<int>(std::min(nx - 1.0, std::ceil((crossings[c + 1] - ox) / dx) - 1));
+                for (int i = first; i <= last; ++i) {
+                    mask[i + static_cast<size_t>(nx) * (j + static_cast<size_t>(ny) * k)] = 1;
+                }
+            }
+        }
+    }
+}
+
+std::vector<uint8_t> Geometry::voxelize(int nx, int ny, int nz, double dx,
+                                        double ox, double oy, double oz) const {
+    std::vector<uint8_t> mask(static_cast<size_t>(nx) * ny * nz, 0);
+
+    for (const Shape& shape : shapes) {
+        voxelizeShape(shape, mask, nx, ny, nz, dx, ox, oy, oz);
+    }
+    for (const Mesh& mesh : meshes) {
+        voxelizeMesh(mesh, mask, nx, ny, nz, dx, ox, oy, oz);
+    }
+    return mask;
+}
+
+uint64_t Geometry::hash(int nx, int ny, int nz, double dx, double ox, double oy, double oz) const {
+    uint64_t h = 14695981039346656037ULL;
+
+    for (const Shape& shape : shapes) {
+        hashValue(h, static_cast<int>(shape.type));
+        hashValue(h, shape.axis);
+        hashBytes(h, shape.params, sizeof(shape.params));
+    }
+    for (const Mesh& mesh : meshes) {
+        hashValue(h, mesh.triangles.size());
+        hashBytes(h, mesh.triangles.data(), mesh.triangles.size() * sizeof(Triangle));
+    }
+
+    hashValue(h, nx);
+    hashValue(h, ny);
+    hashValue(h, nz);
+    hashValue(h, dx);
+    hashValue(h, ox);
+    hashValue(h, oy);
+    hashValue(h, oz);
+    return h;
+}
+
+std::vector<uint8_t> Geometry::voxelizeCached(const std::string& cache_dir,
+                                              int nx, int ny, int nz, double dx,
+                                              double ox, double oy, double oz) const {
+    uint64_t key = hash(nx, ny, nz, dx, ox, oy, oz);
+    size_t size = static_cast<size_t>(nx) * ny * nz;
+
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key
+         << std::dec << "_" << nx << "x" << ny << "x" << nz << ".mask";
+    std::filesystem::path path = std::filesystem::path(cache_dir) / name.str();
+
+    // Cache file: magic, grid size, hash, then the mask packed 8 cells per byte
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        char magic[8];
+        int32_t dims[3];
+        uint64_t stored_key;
+        in.read(magic, sizeof(magic));
+        in.read(reinterpret_cast<char*>(dims), sizeof(dims));
+        in.read(reinterpret_cast<char*>(&stored_key), sizeof(stored_key));
+
+        std::vector<uint8_t> packed((size + 7) / 8);
+        in.read(reinterpret_cast<char*>(packed.data()), packed.size());
+
+        if (in && std::memcmp(magic, kCacheMagic, sizeof(magic)) == 0 &&
+            dims[0] == nx && dims[1] == ny && dims[2] == nz && stored_key == key) {
+            std::vector<uint8_t> mask(size);
+            #pragma omp parallel for
+            for (long long n = 0; n < static_cast<long long>(size); ++n) {
+                mask[n] = (packed[n >> 3] >> (n & 7)) & 1;
+            }
+            return mask;
+        }
+        std::cerr << "Warning: Ignoring invalid voxel cache " << path.string() << std::endl;
+    }
+
+    std::vector<uint8_t> mask = voxelize(nx, ny, nz, dx, ox, oy, oz);
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Warning: Cannot write voxel cache " << path.string() << std::endl;
+        return mask;
+    }
+
+    std::vector<uint8_t> packed((size + 7) / 8, 0);
+    #pragma omp parallel for
+    for (long long b = 0; b < static_cast<long long>(packed.size()); ++b) {
+        uint8_t bits = 0;
+        for (int n = 0; n < 8 && b * 8 + n < static_cast<long long>(size); ++n) {
+            bits |= static_cast<uint8_t>(mask[b * 8 + n] << n);
+        }
+        packed[b] = bits;
+    }
+
+    int32_t dims[3] = {nx, ny, nz};
+    out.write(kCacheMagic, sizeof(kCacheMagic));
+    out.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    out.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+    return mask;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Obstacle geometry in world coordinates. Grid point (i, j, k) of a grid
+// with spacing dx and origin o sits at o + (i, j, k) * dx, matching the
+// VTK output.
+class Geometry {
+public:
+    // Analytic primitives
+    void addSphere(double cx, double cy, double cz, double radius);
+    // axis: 0 = x, 1 = y, 2 = z. (a, b) is the centre in the two remaining
+    // coordinates in x, y, z order; [lo, hi] bounds the extent along the axis.
+    void addCylinder(int axis, double a, double b, double radius, double lo, double hi);
+    void addBox(double x0, double y0, double z0, double x1, double y1, double z1);
+
+    // Closed triangle mesh from an ASCII or binary STL file
+    bool addSTL(const std::string& filename, double scale, double tx, double ty, double tz);
+
+    // Read a scene file, one shape per line ('#' starts a comment):
+    //   sphere   cx cy cz radius
+    //   cylinder x|y|z a b radius [lo hi]
+    //   box      x0 y0 z0 x1 y1 z1
+    //   stl      file.stl [scale [tx ty tz]]
+    // STL paths are relative to the scene file.
+    bool loadScene(const std::string& filename);
+
+    bool empty() const { return shapes.empty() && meshes.empty(); }
+
+    // Rasterize into an nx*ny*nz mask (1 = obstacle), indexed like
+    // FluidSolver: i + nx * (j + ny * k)
+    std::vector<uint8_t> voxelize(int nx, int ny, int nz, double dx,
+                                  double ox = 0.0, double oy = 0.0, double oz = 0.0) const;
+
+    // Same as voxelize(), but reuses a mask stored in cache_dir by an
+    // earlier run with identical geometry and grid
+    std::vector<uint8_t> voxelizeCached(const std::string& cache_dir,
+                                        int nx, int ny, int nz, double dx,
+                                        double ox = 0.0, double oy = 0.0, double oz = 0.0) const;
+
+    // FNV-1a hash of the geometry description together with the grid
+    uint64_t hash(int nx, int ny, int nz, double dx, double ox, double oy, double oz) const;
+
+private:
+    struct Shape {
+        enum Type { Sphere, Cylinder, Box } type;
+        int axis;
+        double params[6];
+        double bounds[6];  // xmin, ymin, zmin, xmax, ymax, zmax
+    };
+
+    struct Triangle {
+        double v[3][3];
+    };
+
+    struct Mesh {
+        std::vector<Triangle> triangles;
+        double bounds[6];
+    };
+
+    std::vector<Shape> shapes;
+    std::vector<Mesh> meshes;
+
+    static bool inside(const Shape& shape, double x, double y, double z);
+    void voxelizeShape(const Shape& shape, std::vector<uint8_t>& mask,
+                       int nx, int ny, int nz, double dx,
+                       double ox, double oy, double oz) const;
+    void voxelizeMesh(const Mesh& mesh, std::vector<uint8_t>& mask,
+                      int nx, int ny, int nz, double dx,
+                      double ox, double oy, double oz) const;
+};
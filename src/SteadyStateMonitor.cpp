@@ -0,0 +1,197 @@
+#include "SteadyStateMonitor.h"
+#include <cmath>
+
+SteadyStateMonitor::SteadyStateMonitor(const FluidSolver& solver)
+    : solver(solver), samples(0), quiet_steps(0), stationary_steps(0),
+      state(State::Transient), frequency(0.0), peak_share(0.0) {
+    setCriteria(criteria);
+}
+
+void SteadyStateMonitor::setCriteria(const Criteria& c) {
+    criteria = c;
+    criteria.window = std::max(criteria.window, 16);
+    criteria.patience = std::max(criteria.patience, 1);
+
+    int window = criteria.window;
+    const double two_pi = 2.0 * std::acos(-1.0);
+    cos_table.resize(window);
+    sin_table.resize(window);
+    hann.resize(window);
+    for (int n = 0; n < window; ++n) {
+        double angle = two_pi * n / window;
+        cos_table[n] = std::cos(angle);
+        sin_table[n] = std::sin(angle);
+        hann[n] = 0.5 - 0.5 * std::cos(angle);
+    }
+    int half = window / 2;
+    hann_half.resize(half);
+    for (int n = 0; n < half; ++n) {
+        hann_half[n] = 0.5 - 0.5 * std::cos(two_pi * n / half);
+    }
+    resetSignals();
+}
+
+void SteadyStateMonitor::addProbe(int i, int j, int k) {
+    if (i < 0 || i >= solver.getNx() || j < 0 || j >= solver.getNy() ||
+        k < 0 || k >= solver.getNz()) {
+        return;
+    }
+    probe_cells.push_back(i + static_cast<size_t>(solver.getNx()) *
+                                  (j + static_cast<size_t>(solver.getNy()) * k));
+    resetSignals();
+}
+
+void SteadyStateMonitor::resetSignals() {
+    signals.assign(2 * probe_cells.size(), std::vector<double>(criteria.window, 0.0));
+    samples = 0;
+    stationary_steps = 0;
+}
+
+const char* SteadyStateMonitor::stateName(State state) {
+    switch (state) {
+        case State::Steady: return "steady";
+        case State::Periodic: return "periodic";
+        case State::Stationary: return "stationary";
+        default: return "transient";
+    }
+}
+
+bool SteadyStateMonitor::analyseSignal(const std::vector<double>& ring, bool& constant,
+                                       double& peak_frequency, double& fraction) const {
+    int window = criteria.window;
+    int half = window / 2;
+    int oldest = samples % window;
+
+    // Oldest sample first
+    std::vector<double> x(window);
+    for (int n = 0; n < window; ++n) {
+        x[n] = ring[(oldest + n) % window];
+    }
+
+    // Mean and spread of the whole window
+    double sum = 0.0, sum_sq = 0.0;
+    for (int n = 0; n < window; ++n) {
+        sum += x[n];
+        sum_sq += x[n] * x[n];
+    }
+    double mean = sum / window;
+    double spread = std::sqrt(std::max(0.0, sum_sq / window - mean * mean));
+
+    peak_frequency = 0.0;
+    fraction = 0.0;
+    constant = spread <= 1e-9 + 1e-6 * std::abs(mean);
+    if (constant) {
+        return true;
+    }
+
+    // Mean and deviation from the window mean of both halves, each tapered
+    // with a Hann window so oscillations cut off mid-period at the half
+    // boundaries do not show up as drift
+    double mean_half[2] = {0.0, 0.0}, std_half[2] = {0.0, 0.0}, weight = 0.0;
+    for (int n = 0; n < half; ++n) {
+        weight += hann_half[n];
+        for (int h = 0; h < 2; ++h) {
+            double value = x[h * half + n];
+            mean_half[h] += hann_half[n] * value;
+            std_half[h] += hann_half[n] * (value - mean) * (value - mean);
+        }
+    }
+    for (int h = 0; h < 2; ++h) {
+        mean_half[h] /= weight;
+        std_half[h] = std::sqrt(std_half[h] / weight);
+    }
+
+    // Probe samples are strongly correlated, so a standard error assuming
+    // independent samples does not apply; the halves are compared against
+    // the spread alone
+    double drift = criteria.drift_tolerance * spread;
+    bool stationary = std::abs(mean_half[1] - mean_half[0]) <= drift &&
+                      std::abs(std_half[1] - std_half[0]) <= drift;
+
+    // Power spectrum of the mean-free, Hann-windowed signal
+    std::vector<double> y(window);
+    for (int n = 0; n < window; ++n) {
+        y[n] = (x[n] - mean) * hann[n];
+    }
+    std::vector<double> power(half + 1, 0.0);
+    double total = 0.0;
+    int peak = 1;
+    for (int m = 1; m <= half; ++m) {
+        double re = 0.0, im = 0.0;
+        for (int n = 0; n < window; ++n) {
+            int t = static_cast<int>((static_cast<long long>(m) * n) % window);
+            re += y[n] * cos_table[t];
+            im -= y[n] * sin_table[t];
+        }
+        power[m] = re * re + im * im;
+        total += power[m];
+        if (power[m] > power[peak]) peak = m;
+    }
+
+    // The Hann window spreads a pure tone over the neighbouring bins. A
+    // peak in the first bin is a trend rather than a resolved oscillation.
+    if (total > 0.0 && peak >= 2) {
+        double peak_power = power[peak];
+        peak_power += power[peak - 1];
+        if (peak < half) peak_power += power[peak + 1];
+        fraction = peak_power / total;
+        peak_frequency = peak / (window * solver.getDt());
+    }
+    return stationary;
+}
+
+void SteadyStateMonitor::update() {
+    // Steady criterion from the solver's field metrics
+    const FluidSolver::StepMetrics& metrics = solver.getMetrics();
+    if (solver.metricsEnabled() && metrics.velocity_change_l2 < criteria.change_tolerance) {
+        ++quiet_steps;
+    } else {
+        quiet_steps = 0;
+    }
+
+    // Record probes
+    const Field& v = solver.getVelocityV();
+    const Field& w = solver.getVelocityW();
+    int slot = samples % criteria.window;
+    for (size_t p = 0; p < probe_cells.size(); ++p) {
+        signals[2 * p][slot] = v[probe_cells[p]];
+        signals[2 * p + 1][slot] = w[probe_cells[p]];
+    }
+    ++samples;
+
+    // Probe criterion: every signal stationary, at least one actually varying
+    bool probes_stationary = !probe_cells.empty() && samples >= criteria.window;
+    bool probes_varying = false;
+    frequency = 0.0;
+    peak_share = 0.0;
+    if (probes_stationary) {
+        for (const std::vector<double>& ring : signals) {
+            bool constant;
+            double signal_frequency, fraction;
+            if (!analyseSignal(ring, constant, signal_frequency, fraction)) {
+                probes_stationary = false;
+            }
+            probes_varying = probes_varying || !constant;
+            if (fraction > peak_share) {
+                peak_share = fraction;
+                frequency = signal_frequency;
+            }
+        }
+    }
+
+    // A single window can pass by the phase of a slow trend; the probes
+    // must stay stationary for a whole further window
+    if (probes_stationary && probes_varying) {
+        ++stationary_steps;
+    } else {
+        stationary_steps = 0;
+    }
+
+    if (quiet_steps >= criteria.patience) {
+        state = State::Steady;
+    } else if (stationary_steps >= criteria.window) {
+        state = peak_share >= criteria.peak_fraction ? State::Periodic : State::Stationary;
+    } else {
+        state = State::Transient;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "FluidSolver.h"
+#include <vector>
+
+// Decides when a run has stopped evolving, from the solver's step metrics
+// and a few velocity probes.
+//
+//   Steady:     the relative L2 velocity change stays below a tolerance
+//   Periodic:   every probe signal is statistically stationary over the
+//               window, for a whole further window of steps, and one has a
+//               dominant spectral peak (vortex shedding)
+//   Stationary: the same, without a clear peak
+//
+// Broadband (turbulent) probe signals may need a larger drift_tolerance
+// to be recognised as stationary.
+//
+// The solver must have metrics enabled (FluidSolver::enableMetrics).
+class SteadyStateMonitor {
+public:
+    enum class State { Transient, Steady, Periodic, Stationary };
+
+    struct Criteria {
+        double change_tolerance = 1e-4;  // Relative L2 velocity change per step
+        int patience = 20;               // Consecutive steps below change_tolerance
+        int window = 256;                // Probe samples per analysis window
+        double drift_tolerance = 0.1;    // Mean/std change between window halves,
+                                         // relative to std
+        double peak_fraction = 0.5;      // Share of spectral power in the dominant peak
+    };
+
+    explicit SteadyStateMonitor(const FluidSolver& solver);
+
+    void setCriteria(const Criteria& c);
+
+    // Record v and w at grid cell (i, j, k) every step
+    void addProbe(int i, int j, int k);
+
+    // Call after every solver step
+    void update();
+
+    State getState() const { return state; }
+    bool isConverged() const { return state != State::Transient; }
+
+    // Dominant probe frequency (1/time) and its share of the spectral power,
+    // from the most recent full window; 0 before the window has filled
+    double getFrequency() const { return frequency; }
+    double getPeakFraction() const { return peak_share; }
+
+    static const char* stateName(State state);
+
+private:
+    const FluidSolver& solver;
+    Criteria criteria;
+
+    std::vector<size_t> probe_cells;
+    std::vector<std::vector<double>> signals;   // Ring buffers, two per probe
+    int samples;                                // Samples recorded so far
+    int quiet_steps;                            // Consecutive steps below change_tolerance
+    int stationary_steps;                       // Consecutive steps with stationary probes
+
+    // Twiddle table for the windowed DFT, and the taper for the half-window
+    // drift test
+    std::vector<double> cos_table, sin_table, hann, hann_half;
+
+    State state;
+    double frequency;
+    double peak_share;
+
+    void resetSignals();
+
+    // Analyse one signal over the last window. Returns false if it drifts.
+    // constant is set for signals without meaningful variation.
+    bool analyseSignal(const std::vector<double>& ring, bool& constant,
+                       double& peak_frequency, double& fraction) const;
+};
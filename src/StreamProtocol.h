@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the shared-memory segment written by StreamPublisher.
+//
+// The segment is a StreamHeader followed by num_slots frame slots of
+// slot_bytes each. A slot is a StreamFrame followed by the frame data:
+// num_fields float arrays of dims[0] * dims[1] * dims[2] values, x fastest,
+// in the order of field_names.
+//
+// Frames are numbered from 1. Frame f goes to slot f % num_slots and is
+// guarded by that slot's sequence number (a seqlock):
+//
+//   writer: seq = 2f - 1, write data, seq = 2f, latest = f
+//   reader: f = latest; s = seq; if s != 2f the slot was reused, retry;
+//           read data in place; if seq != s after reading, retry
+//
+// The writer never waits for readers. A reader working on a slot has
+// num_slots - 1 frames of time before the slot is reused.
+
+const char kStreamMagic[8] = {'F', 'S', 'S', 'T', 'R', 'M', '0', '1'};
+const int kStreamMaxFields = 8;
+const int kStreamNameLength = 16;
+
+struct StreamHeader {
+    char magic[8];
+    uint32_t num_slots;
+    uint32_t num_fields;
+    int32_t dims[3];                  // Published grid, after downsampling
+    int32_t stride;                   // Downsampling factor
+    double spacing;                   // Cell size of the published grid
+    uint64_t slot_bytes;
+    char field_names[kStreamMaxFields][kStreamNameLength];
+
+    std::atomic<uint64_t> latest;     // Last complete frame, 0 if none yet
+    std::atomic<uint32_t> readers;    // Attached consumers; no copies while 0
+    std::atomic<uint32_t> closed;     // Set when the publisher goes away
+};
+
+struct StreamFrame {
+    std::atomic<uint64_t> seq;        // Odd while being written
+    uint64_t step;
+    double time;
+    uint64_t padding;                 // Keeps the float data 32-byte aligned
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "stream protocol needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "stream protocol needs lock-free 32-bit atomics");
+
+inline size_t streamHeaderBytes() {
+    // Round up so every slot starts on a cache line
+    return (sizeof(StreamHeader) + 63) & ~size_t(63);
+}
+
+inline size_t streamSlotBytes(uint32_t num_fields, const int32_t dims[3]) {
+    size_t values = size_t(num_fields) * dims[0] * dims[1] * dims[2];
+    return (sizeof(StreamFrame) + values * sizeof(float) + 63) & ~size_t(63);
+}
+
+inline StreamFrame* streamSlot(void* segment, const StreamHeader& header, uint64_t frame) {
+    char* base = static_cast<char*>(segment) + streamHeaderBytes();
+    return reinterpret_cast<StreamFrame*>(base + (frame % header.num_slots) * header.slot_bytes);
+}
+
+inline float* streamFrameData(StreamFrame* frame) {
+    return reinterpret_cast<float*>(frame + 1);
+}
@@ -0,0 +1,202 @@
+#include "StreamPublisher.h"
+#include "StreamProtocol.h"
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#if defined(__unix__) || defined(__APPLE__)
+#define STREAM_HAVE_SHM 1
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* const kFieldNames[] = {"density", "temperature", "u", "v", "w", "pressure"};
+
+} // namespace
+
+StreamPublisher::~StreamPublisher() {
+    close();
+}
+
+const Field* StreamPublisher::solverField(const FluidSolver& solver, const std::string& field) {
+    if (field == "density") return &solver.getDensity();
+    if (field == "temperature") return &solver.getTemperature();
+    if (field == "u") return &solver.getVelocityU();
+    if (field == "v") return &solver.getVelocityV();
+    if (field == "w") return &solver.getVelocityW();
+    if (field == "pressure") return &solver.getPressure();
+    return nullptr;
+}
+
+bool StreamPublisher::parseFields(const std::string& list, std::vector<std::string>& fields) {
+    fields.clear();
+    std::istringstream stream(list);
+    std::string field;
+    while (std::getline(stream, field, ',')) {
+        bool known = false;
+        for (const char* candidate : kFieldNames) {
+            known = known || field == candidate;
+        }
+        if (!known) {
+            std::cerr << "Error: Unknown stream field '" << field << "' (expected one of "
+                      << "density, temperature, u, v, w, pressure)" << std::endl;
+            return false;
+        }
+        fields.push_back(field);
+    }
+    if (fields.empty() || static_cast<int>(fields.size()) > kStreamMaxFields) {
+        std::cerr << "Error: Stream needs 1 to " << kStreamMaxFields << " fields" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool StreamPublisher::open(const std::string& segment_name, const FluidSolver& solver,
+                           const std::vector<std::string>& fields, int sample_stride,
+                           int num_slots) {
+    close();
+    if (fields.empty() || static_cast<int>(fields.size()) > kStreamMaxFields ||
+        sample_stride < 1 || num_slots < 2) {
+        return false;
+    }
+
+#ifdef STREAM_HAVE_SHM
+    int32_t dims[3] = {(solver.getNx() + sample_stride - 1) / sample_stride,
+                       (solver.getNy() + sample_stride - 1) / sample_stride,
+                       (solver.getNz() + sample_stride - 1) / sample_stride};
+    size_t slot_bytes = streamSlotBytes(static_cast<uint32_t>(fields.size()), dims);
+    size_t bytes = streamHeaderBytes() + num_slots * slot_bytes;
+
+    // The publisher holds an flock() on the object for as long as it runs,
+    // and the kernel drops it when the process exits. An existing object
+    // whose lock is free was left behind by a crashed run and would
+    // otherwise be reused with the wrong layout, so it is replaced (readers
+    // still attached keep their mapping); a locked one belongs to a live run.
+    int existing = shm_open(segment_name.c_str(), O_RDWR, 0);
+    if (existing >= 0) {
+        bool live = flock(existing, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+        ::close(existing);
+        if (live) {
+            std::cerr << "Error: Shared memory " << segment_name
+                      << " is in use by a running publisher" << std::endl;
+            return false;
+        }
+        shm_unlink(segment_name.c_str());
+    }
+    int fd = shm_open(segment_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot create shared memory " << segment_name << std::endl;
+        return false;
+    }
+    void* mapping = MAP_FAILED;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0 && ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Cannot map shared memory " << segment_name << std::endl;
+        ::close(fd);
+        shm_unlink(segment_name.c_str());
+        return false;
+    }
+
+    // The object starts zeroed: no frames, no readers, all slot sequences 0
+    header = new (mapping) StreamHeader();
+    header->num_slots = static_cast<uint32_t>(num_slots);
+    header->num_fields = static_cast<uint32_t>(fields.size());
+    std::memcpy(header->dims, dims, sizeof(dims));
+    header->stride = sample_stride;
+    header->spacing = solver.getDx() * sample_stride;
+    header->slot_bytes = slot_bytes;
+    for (size_t f = 0; f < fields.size(); ++f) {
+        std::strncpy(header->field_names[f], fields[f].c_str(), kStreamNameLength - 1);
+    }
+    for (int s = 0; s < num_slots; ++s) {
+        new (streamSlot(mapping, *header, s)) StreamFrame();
+    }
+
+    // Consumers check the magic last, so it marks the header as complete
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, kStreamMagic, sizeof(kStreamMagic));
+
+    name = segment_name;
+    segment = mapping;
+    segment_bytes = bytes;
+    lock_fd = fd;
+    field_names = fields;
+    stride = sample_stride;
+    frame = 0;
+    return true;
+#else
+    (void)segment_name;
+    (void)solver;
+    std::cerr << "Error: Shared-memory streaming is not available on this platform" << std::endl;
+    return false;
+#endif
+}
+
+void StreamPublisher::close() {
+#ifdef STREAM_HAVE_SHM
+    if (!header) {
+        return;
+    }
+    // Tell attached readers no further frames will come
+    header->closed.store(1, std::memory_order_release);
+    munmap(segment, segment_bytes);
+    shm_unlink(name.c_str());
+    ::close(lock_fd);
+    lock_fd = -1;
+#endif
+    header = nullptr;
+    segment = nullptr;
+    segment_bytes = 0;
+}
+
+bool StreamPublisher::publish(const FluidSolver& solver) {
+    if (!header || header->readers.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    int nx = solver.getNx(), ny = solver.getNy();
+    int sx = header->dims[0], sy = header->dims[1], sz = header->dims[2];
+    size_t values_per_field = static_cast<size_t>(sx) * sy * sz;
+
+    // Seqlock write: mark the slot as in progress before touching its data
+    uint64_t next = frame + 1;
+    StreamFrame* slot = streamSlot(segment, *header, next);
+    slot->seq.store(2 * next - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->step = static_cast<uint64_t>(solver.getStepCount());
+    slot->time = solver.getTime();
+
+    float* data = streamFrameData(slot);
+    for (size_t f = 0; f < field_names.size(); ++f) {
+        const Field& field = *solverField(solver, field_names[f]);
+        float* out = data + f * values_per_field;
+
+        // Rows are converted to float on the way, so even at stride 1 this
+        // writes half the bytes of the solver field
+        #pragma omp parallel for collapse(2)
+        for (int k = 0; k < sz; ++k) {
+            for (int j = 0; j < sy; ++j) {
+                size_t src_row = static_cast<size_t>(j) * stride + static_cast<size_t>(ny) * k * stride;
+                size_t dst_row = static_cast<size_t>(j) + static_cast<size_t>(sy) * k;
+                const double* row = field.data() + src_row * nx;
+                float* dst = out + dst_row * sx;
+                for (int i = 0; i < sx; ++i) {
+                    dst[i] = static_cast<float>(row[i * stride]);
+                }
+            }
+        }
+    }
+
+    slot->seq.store(2 * next, std::memory_order_release);
+    header->latest.store(next, std::memory_order_release);
+    frame = next;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "FluidSolver.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct StreamHeader;
+
+// Publishes the latest solver state through a POSIX shared-memory ring
+// buffer (layout in StreamProtocol.h) for live visualization clients.
+// publish() never blocks on readers, and skips the copy entirely while no
+// consumer is attached.
+class StreamPublisher {
+public:
+    StreamPublisher() = default;
+    ~StreamPublisher();
+
+    StreamPublisher(const StreamPublisher&) = delete;
+    StreamPublisher& operator=(const StreamPublisher&) = delete;
+
+    // Create the shared-memory object name (e.g. "/fluid_sim"). An object
+    // left behind by a publisher that has exited is replaced; one still
+    // held by a running publisher is an error. fields are taken from
+    // density, temperature, u, v, w, pressure; every stride-th cell is
+    // published in each direction.
+    bool open(const std::string& name, const FluidSolver& solver,
+              const std::vector<std::string>& fields, int stride, int num_slots = 4);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    // Copy the solver state into the next slot. Returns false if nothing
+    // was published because no consumer is attached.
+    bool publish(const FluidSolver& solver);
+
+    uint64_t getFramesPublished() const { return frame; }
+
+    // Split a comma-separated field list, checking the names
+    static bool parseFields(const std::string& list, std::vector<std::string>& fields);
+
+private:
+    std::string name;
+    void* segment = nullptr;
+    size_t segment_bytes = 0;
+    int lock_fd = -1;      // Object descriptor, flock()ed while we publish
+    StreamHeader* header = nullptr;
+    std::vector<std::string> field_names;
+    int stride = 1;
+    uint64_t frame = 0;    // Last frame written
+
+    static const Field* solverField(const FluidSolver& solver, const std::string& field);
+};
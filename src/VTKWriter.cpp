@@ -2,18 +2,29 @@
 #include <vtkImageData.h>
 #include <vtkFloatArray.h>
 #include <vtkPointData.h>
+#include <vtkCellData.h>
 #include <vtkXMLImageDataWriter.h>
 #include <vtkSmartPointer.h>
+#include <vtkAMRBox.h>
+#include <vtkAMRUtilities.h>
+#include <vtkOverlappingAMR.h>
+#include <vtkStructuredData.h>
+#include <vtkUniformGrid.h>
+#include <vtkXMLUniformGridAMRWriter.h>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
 
 void VTKWriter::writeVTK(const std::string& filename,
                         int nx, int ny, int nz,
                         double dx,
-                        const std::vector<double>& density,
-                        const std::vector<double>& temperature,
-                        const std::vector<double>& u,
-                        const std::vector<double>& v,
-                        const std::vector<double>& w,
+                        const Field& density,
+                        const Field& temperature,
+                        const Field& u,
+                        const Field& v,
+                        const Field& w,
                         const std::vector<bool>& obstacles) {
     
     // Create image data (structured grid)
@@ -22,14 +33,14 @@ void VTKWriter::writeVTK(const std::string& filename,
     imageData->SetSpacing(dx, dx, dx);
     imageData->SetOrigin(0.0, 0.0, 0.0);
     
-    int numPoints = nx * ny * nz;
+    vtkIdType numPoints = static_cast<vtkIdType>(nx) * ny * nz;
     
     // Create density array
     vtkSmartPointer<vtkFloatArray> densityArray = vtkSmartPointer<vtkFloatArray>::New();
     densityArray->SetName("density");
     densityArray->SetNumberOfComponents(1);
     densityArray->SetNumberOfTuples(numPoints);
-    for (int i = 0; i < numPoints; ++i) {
+    for (vtkIdType i = 0; i < numPoints; ++i) {
         densityArray->SetValue(i, static_cast<float>(density[i]));
     }
     imageData->GetPointData()->AddArray(densityArray);
@@ -39,7 +50,7 @@ void VTKWriter::writeVTK(const std::string& filename,
     temperatureArray->SetName("temperature");
     temperatureArray->SetNumberOfComponents(1);
     temperatureArray->SetNumberOfTuples(numPoints);
-    for (int i = 0; i < numPoints; ++i) {
+    for (vtkIdType i = 0; i < numPoints; ++i) {
         temperatureArray->SetValue(i, static_cast<float>(temperature[i]));
     }
     imageData->GetPointData()->AddArray(temperatureArray);
@@ -49,7 +60,7 @@ void VTKWriter::writeVTK(const std::string& filename,
     obstacleArray->SetName("obstacle");
     obstacleArray->SetNumberOfComponents(1);
     obstacleArray->SetNumberOfTuples(numPoints);
-    for (int i = 0; i < numPoints; ++i) {
+    for (vtkIdType i = 0; i < numPoints; ++i) {
         obstacleArray->SetValue(i, obstacles[i] ? 1.0f : 0.0f);
     }
     imageData->GetPointData()->AddArray(obstacleArray);
@@ -59,7 +70,7 @@ void VTKWriter::writeVTK(const std::string& filename,
     velocityMagArray->SetName("velocity_magnitude");
     velocityMagArray->SetNumberOfComponents(1);
     velocityMagArray->SetNumberOfTuples(numPoints);
-    for (int i = 0; i < numPoints; ++i) {
+    for (vtkIdType i = 0; i < numPoints; ++i) {
         float mag = std::sqrt(u[i]*u[i] + v[i]*v[i] + w[i]*w[i]);
         velocityMagArray->SetValue(i, mag);
     }
@@ -70,7 +81,7 @@ void VTKWriter::writeVTK(const std::string& filename,
     velocityArray->SetName("velocity");
     velocityArray->SetNumberOfComponents(3);
     velocityArray->SetNumberOfTuples(numPoints);
-    for (int i = 0; i < numPoints; ++i) {
+    for (vtkIdType i = 0; i < numPoints; ++i) {
         velocityArray->SetTuple3(i, 
                                 static_cast<float>(u[i]), 
                                 static_cast<float>(v[i]), 
@@ -89,3 +100,213 @@ void VTKWriter::writeVTK(const std::string& filename,
     writer->SetDataModeToBinary();  // Use binary for smaller files
     writer->Write();
 }
+
+void VTKWriter::writeVTKStreamed(const std::string& filename,
+                                 int nx, int ny, int nz,
+                                 double dx,
+                                 const Field& density,
+                                 const Field& temperature,
+                                 const Field& u,
+                                 const Field& v,
+                                 const Field& w,
+                                 const std::vector<bool>& obstacles,
+                                 size_t window_bytes) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Cannot write " << filename << std::endl;
+        return;
+    }
+    
+    // VTK XML image data with raw appended arrays, in writeVTK's order.
+    // Each array is preceded by its size in bytes (UInt64 header).
+    size_t plane = static_cast<size_t>(nx) * ny;
+    uint64_t scalar_bytes = plane * nz * sizeof(float);
+    struct Array { const char* name; int components; };
+    const Array arrays[] = {{"density", 1}, {"temperature", 1}, {"obstacle", 1},
+                            {"velocity_magnitude", 1}, {"velocity", 3}};
+    
+    const uint16_t byte_order_probe = 1;
+    bool little_endian = *reinterpret_cast<const uint8_t*>(&byte_order_probe) == 1;
+    
+    file.precision(17);
+    file << "<?xml version=\"1.0\"?>\n"
+         << "<VTKFile type=\"ImageData\" version=\"1.0\" byte_order=\""
+         << (little_endian ? "LittleEndian" : "BigEndian") << "\" header_type=\"UInt64\">\n"
+         << "  <ImageData WholeExtent=\"0 " << nx - 1 << " 0 " << ny - 1 << " 0 " << nz - 1
+         << "\" Origin=\"0 0 0\" Spacing=\"" << dx << " " << dx << " " << dx << "\">\n"
+         << "    <Piece Extent=\"0 " << nx - 1 << " 0 " << ny - 1 << " 0 " << nz - 1 << "\">\n"
+         << "      <PointData Scalars=\"density\" Vectors=\"velocity\">\n";
+    uint64_t offset = 0;
+    for (const Array& array : arrays) {
+        file << "        <DataArray type=\"Float32\" Name=\"" << array.name
+             << "\" NumberOfComponents=\"" << array.components
+             << "\" format=\"appended\" offset=\"" << offset << "\"/>\n";
+        offset += sizeof(uint64_t) + array.components * scalar_bytes;
+    }
+    file << "      </PointData>\n"
+         << "      <CellData>\n"
+         << "      </CellData>\n"
+         << "    </Piece>\n"
+         << "  </ImageData>\n"
+         << "  <AppendedData encoding=\"raw\">\n"
+         << "   _";
+    
+    // Planes per slab: up to three fields are read and three floats per
+    // cell buffered at once
+    size_t slab_bytes = plane * 3 * (sizeof(double) + sizeof(float));
+    int planes = static_cast<int>(std::max<size_t>(1, window_bytes / slab_bytes));
+    std::vector<float> buffer;
+    
+    // Convert one array slab by slab; value(index, out) fills the array's
+    // components for one cell
+    auto writeArray = [&](int components, std::initializer_list<const Field*> fields,
+                          const auto& value) {
+        uint64_t bytes = components * scalar_bytes;
+        file.write(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+        for (int k0 = 0; k0 < nz; k0 += planes) {
+            int k1 = std::min(k0 + planes, nz);
+            size_t first = k0 * plane, count = (k1 - k0) * plane;
+            for (const Field* field : fields) {
+                field->prefetch(first, count);
+            }
+            buffer.resize(count * components);
+            
+            #pragma omp parallel for
+            for (size_t n = 0; n < count; ++n) {
+                value(first + n, &buffer[n * components]);
+            }
+            file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(float));
+            
+            for (const Field* field : fields) {
+                field->release(first, count);
+            }
+        }
+    };
+    
+    writeArray(1, {&density}, [&](size_t i, float* out) {
+        out[0] = static_cast<float>(density[i]);
+    });
+    writeArray(1, {&temperature}, [&](size_t i, float* out) {
+        out[0] = static_cast<float>(temperature[i]);
+    });
+    writeArray(1, {}, [&](size_t i, float* out) {
+        out[0] = obstacles[i] ? 1.0f : 0.0f;
+    });
+    writeArray(1, {&u, &v, &w}, [&](size_t i, float* out) {
+        out[0] = std::sqrt(u[i]*u[i] + v[i]*v[i] + w[i]*w[i]);
+    });
+    writeArray(3, {&u, &v, &w}, [&](size_t i, float* out) {
+        out[0] = static_cast<float>(u[i]);
+        out[1] = static_cast<float>(v[i]);
+        out[2] = static_cast<float>(w[i]);
+    });
+    
+    file << "\n  </AppendedData>\n"
+         << "</VTKFile>\n";
+    if (!file) {
+        std::cerr << "Error: Failed writing " << filename << std::endl;
+    }
+}
+
+void VTKWriter::writeAMR(const std::string& filename, double dx,
+                         const std::vector<AMRBlock>& blocks) {
+    int num_levels = 0;
+    for (const AMRBlock& block : blocks) {
+        num_levels = std::max(num_levels, block.level + 1);
+    }
+    std::vector<int> blocks_per_level(num_levels, 0);
+    for (const AMRBlock& block : blocks) {
+        ++blocks_per_level[block.level];
+    }
+    
+    // Create the hierarchy; level 0 cell centres sit on the .vti grid points
+    vtkSmartPointer<vtkOverlappingAMR> amr = vtkSmartPointer<vtkOverlappingAMR>::New();
+    amr->Initialize(num_levels, blocks_per_level.data());
+    double origin[3] = {-0.5 * dx, -0.5 * dx, -0.5 * dx};
+    amr->SetOrigin(origin);
+    amr->SetGridDescription(VTK_XYZ_GRID);
+    for (int level = 0; level < num_levels; ++level) {
+        double h = dx / (1 << level);
+        double spacing[3] = {h, h, h};
+        amr->SetSpacing(level, spacing);
+        amr->SetRefinementRatio(level, 2);
+    }
+    
+    std::vector<int> next_index(num_levels, 0);
+    for (const AMRBlock& block : blocks) {
+        double h = dx / (1 << block.level);
+        int hi[3] = {block.lo[0] + block.size[0] - 1,
+                     block.lo[1] + block.size[1] - 1,
+                     block.lo[2] + block.size[2] - 1};
+        unsigned int index = next_index[block.level]++;
+        amr->SetAMRBox(block.level, index, vtkAMRBox(block.lo, hi));
+        
+        // Uniform grid covering the block's cells
+        vtkSmartPointer<vtkUniformGrid> grid = vtkSmartPointer<vtkUniformGrid>::New();
+        grid->SetOrigin(origin[0] + block.lo[0] * h,
+                        origin[1] + block.lo[1] * h,
+                        origin[2] + block.lo[2] * h);
+        grid->SetSpacing(h, h, h);
+        grid->SetDimensions(block.size[0] + 1, block.size[1] + 1, block.size[2] + 1);
+        
+        int numCells = block.size[0] * block.size[1] * block.size[2];
+        
+        vtkSmartPointer<vtkFloatArray> densityArray = vtkSmartPointer<vtkFloatArray>::New();
+        densityArray->SetName("density");
+        densityArray->SetNumberOfTuples(numCells);
+        
+        vtkSmartPointer<vtkFloatArray> temperatureArray = vtkSmartPointer<vtkFloatArray>::New();
+        temperatureArray->SetName("temperature");
+        temperatureArray->SetNumberOfTuples(numCells);
+        
+        vtkSmartPointer<vtkFloatArray> obstacleArray = vtkSmartPointer<vtkFloatArray>::New();
+        obstacleArray->SetName("obstacle");
+        obstacleArray->SetNumberOfTuples(numCells);
+        
+        vtkSmartPointer<vtkFloatArray> velocityMagArray = vtkSmartPointer<vtkFloatArray>::New();
+        velocityMagArray->SetName("velocity_magnitude");
+        velocityMagArray->SetNumberOfTuples(numCells);
+        
+        vtkSmartPointer<vtkFloatArray> velocityArray = vtkSmartPointer<vtkFloatArray>::New();
+        velocityArray->SetName("velocity");
+        velocityArray->SetNumberOfComponents(3);
+        velocityArray->SetNumberOfTuples(numCells);
+        
+        // Copy the block's window out of the (possibly ghosted) source arrays
+        int cell = 0;
+        for (int k = 0; k < block.size[2]; ++k) {
+            for (int j = 0; j < block.size[1]; ++j) {
+                for (int i = 0; i < block.size[0]; ++i, ++cell) {
+                    int n = (block.offset[0] + i) +
+                            block.dims[0] * ((block.offset[1] + j) +
+                                             block.dims[1] * (block.offset[2] + k));
+                    double u = (*block.u)[n], v = (*block.v)[n], w = (*block.w)[n];
+                    densityArray->SetValue(cell, static_cast<float>((*block.density)[n]));
+                    temperatureArray->SetValue(cell, static_cast<float>((*block.temperature)[n]));
+                    obstacleArray->SetValue(cell, (*block.obstacles)[n] ? 1.0f : 0.0f);
+                    velocityMagArray->SetValue(cell, static_cast<float>(std::sqrt(u*u + v*v + w*w)));
+                    velocityArray->SetTuple3(cell, u, v, w);
+                }
+            }
+        }
+        
+        grid->GetCellData()->AddArray(densityArray);
+        grid->GetCellData()->AddArray(temperatureArray);
+        grid->GetCellData()->AddArray(obstacleArray);
+        grid->GetCellData()->AddArray(velocityMagArray);
+        grid->GetCellData()->AddArray(velocityArray);
+        grid->GetCellData()->SetActiveScalars("density");
+        grid->GetCellData()->SetActiveVectors("velocity");
+        
+        amr->SetDataSet(block.level, index, grid);
+    }
+    
+    // Hide base cells that are covered by finer patches
+    vtkAMRUtilities::BlankCells(amr);
+    
+    vtkSmartPointer<vtkXMLUniformGridAMRWriter> writer = vtkSmartPointer<vtkXMLUniformGridAMRWriter>::New();
+    writer->SetFileName(filename.c_str());
+    writer->SetInputData(amr);
+    writer->SetDataModeToBinary();
+    writer->Write();
+}
@@ -1,18 +1,55 @@
 #pragma once
 
+#include "Field.h"
 #include <string>
 #include <vector>
 
 class VTKWriter {
 public:
+    // One block of a cell-centred AMR hierarchy: the cells
+    // [offset, offset + size) of arrays with dimensions dims, placed at cell
+    // index lo of its level. Level l has spacing dx / 2^l.
+    struct AMRBlock {
+        int level;
+        int lo[3];
+        int size[3];
+        int dims[3];
+        int offset[3];
+        const Field* density;
+        const Field* temperature;
+        const Field* u;
+        const Field* v;
+        const Field* w;
+        const std::vector<bool>* obstacles;
+    };
+    
     // Write VTK file using VTK library (outputs .vti XML format)
     static void writeVTK(const std::string& filename,
                         int nx, int ny, int nz,
                         double dx,
-                        const std::vector<double>& density,
-                        const std::vector<double>& temperature,
-                        const std::vector<double>& u,
-                        const std::vector<double>& v,
-                        const std::vector<double>& w,
+                        const Field& density,
+                        const Field& temperature,
+                        const Field& u,
+                        const Field& v,
+                        const Field& w,
                         const std::vector<bool>& obstacles);
+    
+    // Same file as writeVTK, written slab by slab without whole-grid arrays
+    // for out-of-core fields: about window_bytes of field data and output
+    // buffers are resident at a time.
+    static void writeVTKStreamed(const std::string& filename,
+                                 int nx, int ny, int nz,
+                                 double dx,
+                                 const Field& density,
+                                 const Field& temperature,
+                                 const Field& u,
+                                 const Field& v,
+                                 const Field& w,
+                                 const std::vector<bool>& obstacles,
+                                 size_t window_bytes);
+    
+    // Write an AMR hierarchy as vtkOverlappingAMR (.vthb). Level 0 cell
+    // centres coincide with the points written by writeVTK.
+    static void writeAMR(const std::string& filename, double dx,
+                         const std::vector<AMRBlock>& blocks);
 };
@@ -1,10 +1,19 @@
 #include "FluidSolver.h"
 #include "VTKWriter.h"
+#include "Ensemble.h"
+#include "Geometry.h"
+#include "AMRHierarchy.h"
+#include "StreamPublisher.h"
+#include "SteadyStateMonitor.h"
+#include <array>
 #include <iostream>
+#include <fstream>
 #include <iomanip>
 #include <sstream>
 #include <chrono>
 #include <cstring>
+#include <limits>
+#include <memory>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -22,11 +31,59 @@ void printUsage(const char* progName) {
     std::cout << "  --smoke-steps N         Stop smoke generation after N steps (default: same as --steps)\n";
     std::cout << "  --dt TIMESTEP           Time step size (default: 0.1)\n";
     std::cout << "  --dx SPACING            Grid spacing (default: 1.0)\n";
+    std::cout << "  --scene FILE            Load obstacles from a scene file (default: sphere + cylinder)\n";
+    std::cout << "  --voxel-cache DIR       Cache voxelized obstacle masks in DIR\n";
+    std::cout << "  --amr                   Refine blocks near obstacles and flow features (2x)\n";
+    std::cout << "  --amr-block N           AMR block size in base cells (default: 8)\n";
+    std::cout << "  --amr-regrid N          Re-evaluate refinement every N steps (default: 10)\n";
+    std::cout << "  --amr-vorticity X       Refine where |curl u| > X, 0 disables (default: 2.0)\n";
+    std::cout << "  --amr-gradient X        Refine where |grad density| > X, 0 disables (default: 0.1)\n";
+    std::cout << "  --ensemble FILE         Run every member of a parameter sweep file in this process\n";
+    std::cout << "  --member-threads N      OpenMP threads per ensemble member (default: auto)\n";
+    std::cout << "  --member-metrics        Add convergence metrics to ensemble member logs\n";
+    std::cout << "  --out-of-core DIR       Keep fields in files in DIR, paged in slab by slab\n";
+    std::cout << "  --ooc-window MB         Resident memory per out-of-core sweep (default: 256)\n";
+    std::cout << "  --stream NAME           Publish every step to shared memory NAME (e.g. /fluid_sim)\n";
+    std::cout << "  --stream-fields LIST    Streamed fields (default: density,u,v,w)\n";
+    std::cout << "  --stream-stride N       Stream every Nth cell per direction (default: 1)\n";
+    std::cout << "  --log FILE              Write per-step timings and convergence metrics to FILE\n";
+    std::cout << "  --probe I J K           Add a velocity probe at cell (I, J, K) (default: two wake probes)\n";
+    std::cout << "  --steady-stop           Stop once the flow is steady or statistically stationary\n";
+    std::cout << "  --steady-output N       Output every N steps once the flow is stationary\n";
+    std::cout << "  --steady-tol X          Relative velocity change per step counted as steady (default: 1e-4)\n";
+    std::cout << "  --steady-window N       Probe samples per stationarity/spectrum window (default: 256)\n";
     std::cout << "\nExamples:\n";
     std::cout << "  " << progName << " -n 128 -s 500\n";
     std::cout << "  " << progName << " --nx 128 --ny 64 --nz 64 --steps 1000\n";
     std::cout << "  " << progName << " --dt 0.05 --output-interval 5\n";
     std::cout << "  " << progName << " -s 500 --smoke-steps 100  # Generate smoke for first 100 steps only\n";
+    std::cout << "  " << progName << " --ensemble sweep.txt -s 300  # Run a parameter sweep\n";
+    std::cout << "  " << progName << " --amr -n 64 -s 500            # Refine around obstacles and wakes\n";
+    std::cout << "  " << progName << " -n 1024 --out-of-core /scratch  # Grid larger than RAM\n";
+    std::cout << "  " << progName << " --stream /fluid_sim           # Watch with fluid_stream_consumer\n";
+    std::cout << "  " << progName << " -s 5000 --steady-stop --log run.log  # Stop once the wake has settled\n";
+}
+
+// Wind tunnel: smoke tracer emitters at the inlet to visualize flow.
+// strength scales all three streams (used by ensemble sweeps); emission
+// stops at end_time.
+void addSmokeEmitters(FluidSolver& solver, double strength, double end_time) {
+    int ny = solver.getNy();
+    int nz = solver.getNz();
+    double dt = solver.getDt();
+    
+    // Stream 1: Aimed at BOX OBSTACLE (positioned to hit it directly)
+    // Box is at (nx/4, ny/4, nz/4), so align smoke with it
+    solver.addBoxEmitter(3, ny/4, nz/4, 6, ny/4 + 8, nz/4 + 8,
+                         0.06 * strength / dt, 0.0, 0.0, end_time);  // STRONG stream hitting box
+    
+    // Stream 2: Center stream (hitting sphere obstacle)
+    solver.addBoxEmitter(3, ny/2 - 4, nz/2 - 4, 6, ny/2 + 4, nz/2 + 4,
+                         0.04 * strength / dt, 0.0, 0.0, end_time);  // Main stream hitting sphere
+    
+    // Stream 3: Upper stream for contrast
+    solver.addBoxEmitter(3, 3*ny/4, nz/2 - 2, 6, 3*ny/4 + 3, nz/2 + 2,
+                         0.03 * strength / dt, 0.0, 0.0, end_time);  // Upper stream
 }
 
 int main(int argc, char* argv[]) {
@@ -46,6 +103,25 @@ int main(int argc, char* argv[]) {
     int num_steps = 200;
     int output_interval = 10;
     int smoke_steps = -1;  // -1 means same as num_steps
+    std::string scene_file;
+    std::string voxel_cache;
+    std::string ensemble_file;
+    bool use_amr = false;
+    int amr_block = 8;
+    int amr_regrid = 10;
+    AMRHierarchy::Criteria amr_criteria;
+    int member_threads = 0;  // 0 means automatic
+    bool member_metrics = false;
+    std::string spill_dir;
+    int ooc_window_mb = 256;
+    std::string stream_name;
+    std::string stream_fields = "density,u,v,w";
+    int stream_stride = 1;
+    std::string log_file;
+    std::vector<std::array<int, 3>> probes;
+    bool steady_stop = false;
+    int steady_output = 0;  // 0 keeps the output interval
+    SteadyStateMonitor::Criteria steady_criteria;
     
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
@@ -82,6 +158,70 @@ int main(int argc, char* argv[]) {
         else if (arg == "--dx" && i + 1 < argc) {
             dx = std::atof(argv[++i]);
         }
+        else if (arg == "--scene" && i + 1 < argc) {
+            scene_file = argv[++i];
+        }
+        else if (arg == "--voxel-cache" && i + 1 < argc) {
+            voxel_cache = argv[++i];
+        }
+        else if (arg == "--amr") {
+            use_amr = true;
+        }
+        else if (arg == "--amr-block" && i + 1 < argc) {
+            amr_block = std::atoi(argv[++i]);
+        }
+        else if (arg == "--amr-regrid" && i + 1 < argc) {
+            amr_regrid = std::atoi(argv[++i]);
+        }
+        else if (arg == "--amr-vorticity" && i + 1 < argc) {
+            amr_criteria.vorticity = std::atof(argv[++i]);
+        }
+        else if (arg == "--amr-gradient" && i + 1 < argc) {
+            amr_criteria.density_gradient = std::atof(argv[++i]);
+        }
+        else if (arg == "--ensemble" && i + 1 < argc) {
+            ensemble_file = argv[++i];
+        }
+        else if (arg == "--member-threads" && i + 1 < argc) {
+            member_threads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--member-metrics") {
+            member_metrics = true;
+        }
+        else if (arg == "--out-of-core" && i + 1 < argc) {
+            spill_dir = argv[++i];
+        }
+        else if (arg == "--ooc-window" && i + 1 < argc) {
+            ooc_window_mb = std::atoi(argv[++i]);
+        }
+        else if (arg == "--stream" && i + 1 < argc) {
+            stream_name = argv[++i];
+        }
+        else if (arg == "--stream-fields" && i + 1 < argc) {
+            stream_fields = argv[++i];
+        }
+        else if (arg == "--stream-stride" && i + 1 < argc) {
+            stream_stride = std::atoi(argv[++i]);
+        }
+        else if (arg == "--log" && i + 1 < argc) {
+            log_file = argv[++i];
+        }
+        else if (arg == "--probe" && i + 3 < argc) {
+            probes.push_back({std::atoi(argv[i + 1]), std::atoi(argv[i + 2]), std::atoi(argv[i + 3])});
+            i += 3;
+        }
+        else if (arg == "--steady-stop") {
+            steady_stop = true;
+        }
+        else if (arg == "--steady-output" && i + 1 < argc) {
+            steady_output = std::atoi(argv[++i]);
+        }
+        else if (arg == "--steady-tol" && i + 1 < argc) {
+            steady_criteria.change_tolerance = std::atof(argv[++i]);
+        }
+        else if (arg == "--steady-window" && i + 1 < argc) {
+            steady_criteria.window = std::atoi(argv[++i]);
+        }
         else {
             std::cerr << "Unknown option: " << arg << std::endl;
             printUsage(argv[0]);
@@ -115,125 +255,292 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error: Smoke steps must be non-negative\n";
         return 1;
     }
+    if (member_threads < 0) {
+        std::cerr << "Error: Member threads must be non-negative\n";
+        return 1;
+    }
+    if (amr_block < 2 || amr_regrid < 1) {
+        std::cerr << "Error: AMR block size must be at least 2 and regrid interval positive\n";
+        return 1;
+    }
+    if (use_amr && !ensemble_file.empty()) {
+        std::cerr << "Error: --amr cannot be combined with --ensemble\n";
+        return 1;
+    }
+    if (use_amr && !spill_dir.empty()) {
+        std::cerr << "Error: --amr cannot be combined with --out-of-core\n";
+        return 1;
+    }
+    if (ooc_window_mb < 1) {
+        std::cerr << "Error: Out-of-core window must be at least 1 MB\n";
+        return 1;
+    }
+    if (!stream_name.empty() && !ensemble_file.empty()) {
+        std::cerr << "Error: --stream cannot be combined with --ensemble\n";
+        return 1;
+    }
+    if (stream_stride < 1) {
+        std::cerr << "Error: Stream stride must be positive\n";
+        return 1;
+    }
+    if (steady_output < 0 || steady_criteria.change_tolerance < 0 || steady_criteria.window < 16) {
+        std::cerr << "Error: Steady output interval and tolerance must be non-negative, window at least 16\n";
+        return 1;
+    }
+    for (const std::array<int, 3>& probe : probes) {
+        if (probe[0] < 0 || probe[0] >= nx || probe[1] < 0 || probe[1] >= ny ||
+            probe[2] < 0 || probe[2] >= nz) {
+            std::cerr << "Error: Probe (" << probe[0] << ", " << probe[1] << ", " << probe[2]
+                      << ") is outside the grid\n";
+            return 1;
+        }
+    }
+    std::vector<std::string> stream_field_list;
+    if (!stream_name.empty() && !StreamPublisher::parseFields(stream_fields, stream_field_list)) {
+        return 1;
+    }
     
     std::cout << "Grid size: " << nx << "x" << ny << "x" << nz << std::endl;
     std::cout << "Time step: " << dt << std::endl;
     std::cout << "Total steps: " << num_steps << std::endl;
     std::cout << "Smoke generation stops at step: " << smoke_steps << std::endl;
     
+    // Fields allocated from here on are backed by files in the spill directory
+    if (!spill_dir.empty()) {
+        Field::setSpillDirectory(spill_dir);
+    }
+    
+    // Add obstacles - either from a scene file or the default wind tunnel
+    // setup: a sphere in the middle and a vertical cylinder (along y-axis)
+    std::cout << "Adding obstacles..." << std::endl;
+    Geometry geometry;
+    if (!scene_file.empty()) {
+        if (!geometry.loadScene(scene_file)) {
+            return 1;
+        }
+    } else {
+        geometry.addSphere((nx/2) * dx, (ny/2) * dx, (nz/2) * dx, 8 * dx);
+        geometry.addCylinder(1, (nx/4 + 4) * dx, (nz/4 + 4) * dx, 5 * dx,
+                             -std::numeric_limits<double>::infinity(),
+                             std::numeric_limits<double>::infinity());
+    }
+    
+    auto voxel_start = std::chrono::high_resolution_clock::now();
+    std::vector<uint8_t> obstacle_mask = voxel_cache.empty()
+        ? geometry.voxelize(nx, ny, nz, dx)
+        : geometry.voxelizeCached(voxel_cache, nx, ny, nz, dx);
+    // Mask and obstacle cell lists, built once for the solver or for all
+    // ensemble members
+    std::shared_ptr<FluidSolver::ObstacleData> obstacles =
+        FluidSolver::buildObstacles(nx, ny, nz, obstacle_mask);
+    if (!obstacles) {
+        std::cerr << "Error: Obstacle mask has " << obstacle_mask.size() << " cells, expected "
+                  << static_cast<size_t>(nx) * ny * nz << std::endl;
+        return 1;
+    }
+    auto voxel_end = std::chrono::high_resolution_clock::now();
+    
+    std::cout << "Obstacles voxelized in "
+              << std::chrono::duration<double, std::milli>(voxel_end - voxel_start).count()
+              << " ms" << std::endl;
+    
+    // Ensemble mode: all sweep members share the obstacles set up above.
+    // No solver is created here; only the members hold fields.
+    if (!ensemble_file.empty()) {
+        std::vector<EnsembleMember> members;
+        if (!Ensemble::loadSweep(ensemble_file, members)) {
+            return 1;
+        }
+        
+        Ensemble ensemble(nx, ny, nz, dx, dt, obstacles);
+        ensemble.setThreadsPerMember(member_threads);
+        ensemble.setMemberMetrics(member_metrics);
+        ensemble.run(members, num_steps, output_interval,
+                     [smoke_steps, dt](FluidSolver& member_solver, const EnsembleMember& member) {
+                         addSmokeEmitters(member_solver, member.source_strength, smoke_steps * dt);
+                     });
+        
+        std::cout << "\nEnsemble complete! Each member wrote <name>_output_*.vti and <name>.log" << std::endl;
+        return 0;
+    }
+    
     // Create solver
     FluidSolver solver(nx, ny, nz, dx, dt);
+    solver.setMemoryWindow(static_cast<size_t>(ooc_window_mb) << 20);
+    if (solver.isOutOfCore()) {
+        std::cout << "Out-of-core: fields in " << spill_dir << ", "
+                  << ooc_window_mb << " MB window" << std::endl;
+    }
+    if (!solver.shareObstacles(obstacles)) {
+        std::cerr << "Error: Cannot use the obstacle data for this grid" << std::endl;
+        return 1;
+    }
     
     // Configure wind tunnel inlet velocity (flow from left to right)
     solver.setInletVelocity(5.0, 0.0, 0.0);  // 5.0 m/s in x-direction
     std::cout << "Wind tunnel mode: inlet velocity = 5.0 m/s (x-direction)" << std::endl;
     
-    // Add obstacles - create a sphere obstacle in the middle
-    std::cout << "Adding obstacles..." << std::endl;
-    int cx = nx / 2;
-    int cy = ny / 2;
-    int cz = nz / 2;
-    int radius = 8;
-    
-    for (int k = 0; k < nz; ++k) {
-        for (int j = 0; j < ny; ++j) {
-            for (int i = 0; i < nx; ++i) {
-                int dx_obs = i - cx;
-                int dy_obs = j - cy;
-                int dz_obs = k - cz;
-                double dist = std::sqrt(dx_obs*dx_obs + dy_obs*dy_obs + dz_obs*dz_obs);
-                
-                if (dist < radius) {
-                    solver.setObstacle(i, j, k, true);
-                }
-            }
+    // Wind tunnel: smoke tracers at inlet, active for the first smoke_steps steps
+    addSmokeEmitters(solver, 1.0, smoke_steps * dt);
+    
+    std::cout << "Starting simulation..." << std::endl;
+    
+    // AMR mode: the solver above is the base grid, patches are managed by the hierarchy
+    std::unique_ptr<AMRHierarchy> amr;
+    if (use_amr) {
+        amr = std::make_unique<AMRHierarchy>(solver, geometry, amr_block);
+        amr->setCriteria(amr_criteria);
+        amr->setRegridInterval(amr_regrid);
+    }
+    
+    // Live stream of the (base) grid for local visualization clients
+    StreamPublisher stream;
+    if (!stream_name.empty()) {
+        if (!stream.open(stream_name, solver, stream_field_list, stream_stride)) {
+            return 1;
         }
+        std::cout << "Streaming " << stream_fields << " to shared memory " << stream_name << std::endl;
     }
     
-    // Add a cylinder obstacle (vertical, along y-axis)
-    int cyl_cx = nx/4 + 4;  // Center x position
-    int cyl_cz = nz/4 + 4;  // Center z position
-    int cyl_radius = 5;     // Cylinder radius
+    // Convergence monitoring, only when something uses it: the metrics cost
+    // three extra fields and a sweep per step. Without explicit probes,
+    // sample the wakes of the default sphere and cylinder, off-centre so
+    // both v and w vary.
+    const bool monitoring = !log_file.empty() || steady_stop || steady_output > 0;
+    solver.enableMetrics(monitoring);
+    SteadyStateMonitor monitor(solver);
+    monitor.setCriteria(steady_criteria);
+    if (probes.empty()) {
+        probes.push_back({3 * nx / 4, ny / 2 + ny / 16, nz / 2 + nz / 16});
+        probes.push_back({std::min(nx / 4 + 16, nx - 2), ny / 2, nz / 4 + 6});
+    }
+    for (const std::array<int, 3>& probe : probes) {
+        monitor.addProbe(probe[0], probe[1], probe[2]);
+    }
     
-    for (int j = 0; j < ny; ++j) {  // Full height (vertical cylinder)
-        for (int k = 0; k < nz; ++k) {
-            for (int i = 0; i < nx; ++i) {
-                int dx_cyl = i - cyl_cx;
-                int dz_cyl = k - cyl_cz;
-                double dist_cyl = std::sqrt(dx_cyl*dx_cyl + dz_cyl*dz_cyl);
-                
-                if (dist_cyl < cyl_radius) {
-                    solver.setObstacle(i, j, k, true);
-                }
-            }
+    std::ofstream log;
+    if (!log_file.empty()) {
+        log.open(log_file);
+        if (!log) {
+            std::cerr << "Error: Cannot write " << log_file << "\n";
+            return 1;
         }
+        log << "# step time_ms du_l2 du_max div_l2 div_max state frequency peak_fraction" << std::endl;
     }
     
-    std::cout << "Starting simulation..." << std::endl;
+    const int base_output_interval = output_interval;
+    bool converged = false;
+    int stopped_at = -1;
     
     // Main simulation loop
     for (int step = 0; step < num_steps; ++step) {
-        // Wind tunnel: inject smoke tracers at inlet to visualize flow
-        if (step < smoke_steps) {
-            // Stream 1: Aimed at BOX OBSTACLE (positioned to hit it directly)
-            // Box is at (nx/4, ny/4, nz/4), so align smoke with it
-            for (int k = nz/4; k < nz/4 + 8; ++k) {
-                for (int j = ny/4; j < ny/4 + 8; ++j) {
-                    for (int i = 3; i < 6; ++i) {
-                        solver.addSource(i, j, k, 0.06, 0.0);  // STRONG stream hitting box
-                    }
-                }
-            }
-            
-            // Stream 2: Center stream (hitting sphere obstacle)
-            for (int k = nz/2 - 4; k < nz/2 + 4; ++k) {
-                for (int j = ny/2 - 4; j < ny/2 + 4; ++j) {
-                    for (int i = 3; i < 6; ++i) {
-                        solver.addSource(i, j, k, 0.04, 0.0);  // Main stream hitting sphere
-                    }
-                }
-            }
-            
-            // Stream 3: Upper stream for contrast
-            for (int k = nz/2 - 2; k < nz/2 + 2; ++k) {
-                for (int j = 3*ny/4; j < 3*ny/4 + 3; ++j) {
-                    for (int i = 3; i < 6; ++i) {
-                        solver.addSource(i, j, k, 0.03, 0.0);  // Upper stream
-                    }
-                }
-            }
-        }
-        
         // Perform simulation step
         auto start_time = std::chrono::high_resolution_clock::now();
-        solver.step();
+        if (amr) {
+            amr->step();
+        } else {
+            solver.step();
+        }
         auto end_time = std::chrono::high_resolution_clock::now();
         
-        // Output progress
-        if (step % output_interval == 0) {
-            double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        // Only copies while a consumer is attached
+        stream.publish(solver);
+        
+        double elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+        if (monitoring) {
+            monitor.update();
+        }
+        const FluidSolver::StepMetrics& metrics = solver.getMetrics();
+        if (log) {
+            log << step << " " << std::fixed << std::setprecision(3) << elapsed_ms
+                << std::scientific << std::setprecision(4)
+                << " " << metrics.velocity_change_l2 << " " << metrics.velocity_change_max
+                << " " << metrics.divergence_l2 << " " << metrics.divergence_max
+                << " " << SteadyStateMonitor::stateName(monitor.getState())
+                << " " << monitor.getFrequency() << " " << monitor.getPeakFraction() << "\n";
+        }
+        
+        // Report state changes; once converged, optionally output less often
+        if (monitor.isConverged() != converged) {
+            converged = monitor.isConverged();
+            std::cout << "Step " << std::setw(4) << step << ": flow is "
+                      << SteadyStateMonitor::stateName(monitor.getState());
+            if (monitor.getState() == SteadyStateMonitor::State::Periodic) {
+                std::cout << " (f = " << std::fixed << std::setprecision(4)
+                          << monitor.getFrequency() << ")";
+            }
+            std::cout << std::endl;
+            if (steady_output > 0) {
+                output_interval = converged ? steady_output : base_output_interval;
+            }
+        }
+        bool stop = steady_stop && converged;
+        
+        // Output progress (always for the final state of an early stop)
+        if (step % output_interval == 0 || stop) {
             std::cout << "Step " << std::setw(4) << step 
                      << " / " << num_steps 
                      << " - Time: " << std::fixed << std::setprecision(3) 
                      << elapsed_ms << " ms" << std::endl;
+            if (monitoring) {
+                std::cout << "         Metrics: du " << std::scientific << std::setprecision(2)
+                         << metrics.velocity_change_l2 << " (max " << metrics.velocity_change_max
+                         << "), div " << metrics.divergence_l2 << " (max " << metrics.divergence_max
+                         << "), " << SteadyStateMonitor::stateName(monitor.getState())
+                         << std::fixed << std::endl;
+            }
             
-            // Write VTK file (XML format)
-            std::ostringstream filename;
-            filename << "output_" << std::setw(4) << std::setfill('0') << step << ".vti";
-            
-            VTKWriter::writeVTK(filename.str(),
-                              solver.getNx(), solver.getNy(), solver.getNz(),
-                              solver.getDx(),
-                              solver.getDensity(),
-                              solver.getTemperature(),
-                              solver.getVelocityU(),
-                              solver.getVelocityV(),
-                              solver.getVelocityW(),
-                              solver.getObstacles());
+            if (amr) {
+                // Write the hierarchy as vtkOverlappingAMR
+                std::cout << "         AMR: " << amr->getPatches().size() << " patches, "
+                         << amr->getCellCount() << " cells ("
+                         << 8LL * nx * ny * nz << " for uniform refinement)" << std::endl;
+                
+                std::ostringstream filename;
+                filename << "output_" << std::setw(4) << std::setfill('0') << step << ".vthb";
+                VTKWriter::writeAMR(filename.str(), solver.getDx(), amr->getOutputBlocks());
+            } else {
+                // Write VTK file (XML format)
+                std::ostringstream filename;
+                filename << "output_" << std::setw(4) << std::setfill('0') << step << ".vti";
+                
+                if (solver.isOutOfCore()) {
+                    VTKWriter::writeVTKStreamed(filename.str(),
+                                                solver.getNx(), solver.getNy(), solver.getNz(),
+                                                solver.getDx(),
+                                                solver.getDensity(),
+                                                solver.getTemperature(),
+                                                solver.getVelocityU(),
+                                                solver.getVelocityV(),
+                                                solver.getVelocityW(),
+                                                solver.getObstacles(),
+                                                static_cast<size_t>(ooc_window_mb) << 20);
+                } else {
+                    VTKWriter::writeVTK(filename.str(),
+                                      solver.getNx(), solver.getNy(), solver.getNz(),
+                                      solver.getDx(),
+                                      solver.getDensity(),
+                                      solver.getTemperature(),
+                                      solver.getVelocityU(),
+                                      solver.getVelocityV(),
+                                      solver.getVelocityW(),
+                                      solver.getObstacles());
+                }
+                solver.releaseMemory();
+            }
+        }
+        
+        if (stop) {
+            stopped_at = step;
+            break;
         }
     }
     
     std::cout << "\nSimulation complete!" << std::endl;
+    if (stopped_at >= 0) {
+        std::cout << "Stopped early at step " << stopped_at << " of " << num_steps
+                  << " (flow " << SteadyStateMonitor::stateName(monitor.getState()) << ")" << std::endl;
+    }
     std::cout << "VTK files saved (XML format). Open in ParaView to visualize." << std::endl;
     std::cout << "\nParaView tips:" << std::endl;
     std::cout << "- Load output_*.vti files (File -> Open)" << std::endl;
@@ -0,0 +1,178 @@
+// Reference consumer for the fluid_sim live stream (see StreamProtocol.h).
+//
+// Attaches to the shared-memory segment of a run started with --stream,
+// reads every new frame in place and prints per-field statistics. Frames
+// that were overwritten while being read are detected and skipped.
+#include "StreamProtocol.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void onSignal(int) {
+    stop_requested = 1;
+}
+
+struct FieldStats {
+    float min, max;
+    double mean;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// Map the segment if it exists and its header is complete
+void* attach(const std::string& name, size_t& bytes) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    void* segment = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= streamHeaderBytes()) {
+        bytes = static_cast<size_t>(info.st_size);
+        segment = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (segment == MAP_FAILED) {
+        return nullptr;
+    }
+
+    const StreamHeader& header = *static_cast<const StreamHeader*>(segment);
+    if (std::memcmp(header.magic, kStreamMagic, sizeof(kStreamMagic)) != 0) {
+        munmap(segment, bytes);
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return segment;
+}
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string name = "/fluid_sim";
+    long long max_frames = -1;  // -1 means until the publisher exits
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            std::cout << "Usage: " << argv[0] << " [NAME] [--frames N]\n"
+                      << "  NAME        Shared-memory name given to fluid_sim --stream (default: /fluid_sim)\n"
+                      << "  --frames N  Exit after N frames\n";
+            return 0;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            max_frames = std::atoll(argv[++i]);
+        } else {
+            name = arg;
+        }
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    // The publisher may not have started yet
+    std::cout << "Waiting for " << name << "..." << std::endl;
+    size_t bytes = 0;
+    void* segment = attach(name, bytes);
+    while (!segment) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        segment = attach(name, bytes);
+    }
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    StreamHeader& header = *static_cast<StreamHeader*>(segment);
+
+    size_t values = static_cast<size_t>(header.dims[0]) * header.dims[1] * header.dims[2];
+    std::cout << "Attached to " << name << ": " << header.dims[0] << "x" << header.dims[1]
+              << "x" << header.dims[2] << " (stride " << header.stride << "), fields:";
+    for (uint32_t f = 0; f < header.num_fields; ++f) {
+        std::cout << " " << header.field_names[f];
+    }
+    std::cout << std::endl;
+
+    // Announce ourselves; the publisher only copies frames while readers > 0
+    header.readers.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t last = 0;
+    long long received = 0, torn = 0;
+    std::vector<FieldStats> stats(header.num_fields);
+
+    while (!stop_requested && (max_frames < 0 || received < max_frames)) {
+        uint64_t frame = header.latest.load(std::memory_order_acquire);
+        if (frame == last) {
+            if (header.closed.load(std::memory_order_acquire)) {
+                std::cout << "Publisher closed the stream" << std::endl;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+
+        // Seqlock read: the slot must hold this frame before and after
+        StreamFrame* slot = streamSlot(segment, header, frame);
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        if (seq != 2 * frame) {
+            continue;  // Already being reused for a newer frame
+        }
+
+        uint64_t step = slot->step;
+        double time = slot->time;
+        const float* data = streamFrameData(slot);
+        for (uint32_t f = 0; f < header.num_fields; ++f) {
+            const float* values_f = data + f * values;
+            FieldStats s = {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.0};
+            for (size_t n = 0; n < values; ++n) {
+                s.min = std::min(s.min, values_f[n]);
+                s.max = std::max(s.max, values_f[n]);
+                s.mean += values_f[n];
+            }
+            s.mean /= static_cast<double>(values);
+            stats[f] = s;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) != seq) {
+            ++torn;  // Overwritten while we were reading
+            last = frame;
+            continue;
+        }
+
+        if (last != 0 && frame > last + 1) {
+            std::cout << "  (skipped " << frame - last - 1 << " frames)" << std::endl;
+        }
+        last = frame;
+        ++received;
+
+        std::cout << "Frame " << std::setw(5) << frame << "  step " << std::setw(5) << step
+                  << "  t=" << std::fixed << std::setprecision(2) << time;
+        for (uint32_t f = 0; f < header.num_fields; ++f) {
+            std::cout << "  " << header.field_names[f] << " [" << std::setprecision(3)
+                      << stats[f].min << ", " << stats[f].max << "] mean " << stats[f].mean;
+        }
+        std::cout << std::endl;
+    }
+
+    header.readers.fetch_sub(1, std::memory_order_relaxed);
+    munmap(segment, bytes);
+    std::cout << received << " frames received, " << torn << " discarded as torn" << std::endl;
+    return 0;
+#else
+    std::cerr << "Error: Shared-memory streaming is not available on this platform" << std::endl;
+    return 1;
+#endif
+}